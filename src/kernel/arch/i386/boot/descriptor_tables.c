@@ -8,6 +8,8 @@
 #include <kernel/arch/i386/boot/descriptor_tables.h>
 #include <kernel/arch/i386/pic.h>
 #include <kernel/arch/i386/irq.h>
+#include <kernel/arch/i386/x86.h>
+#include <kernel/memory/mmap.h>
 #define GDT_ENTRIES 5
 #define IDT_ENTRIES 256
 
@@ -69,6 +71,12 @@ static int count = 0;
 
 void interrupt_handler(struct intframe_t *frameptr)
 {
+    // Most page faults are pages of a mapped file that were never accessed
+    if (frameptr->int_no == EXCEPTION_PAGE_FAULT && 
+        mmap_handle_fault(read_cr2(), frameptr->err_code) == 0) {
+        return;
+    }
+
     if (frameptr->int_no < IRQ_OFFSET) {
         kprintf(
             "[%d] %s: %d - %d\n", 
@@ -7,6 +7,7 @@
     exceptions.
 */
 #define IRQ_OFFSET 32
+#define EXCEPTION_PAGE_FAULT 14
 #define IRQ_TIMER       (IRQ_OFFSET + 0)
 #define IRQ_KEYBOARD    (IRQ_OFFSET + 1)
 #define IRQ_PS2MOUSE    (IRQ_OFFSET + 12)
@@ -10,6 +10,7 @@
 #include <kernel/lib/kassert.h>
 #include <kernel/process.h>
 #include <kernel/syscall.h>
+#include <kernel/ipc/ipc.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -48,8 +49,13 @@ void dispatch_irq(struct intframe_t *intframe)
     case IRQ_PS2MOUSE:
         __mouse_irq();
         break;
-    case IRQ_SYSCALL:
-        intframe->eax = syscall(
+    case IRQ_SYSCALL: {
+        // These pick the process to run next by themselves
+        if (ipc_is_syscall(intframe->eax)) {
+            ipc_syscall(intframe);
+            break;
+        }
+        int result = syscall(
             intframe->eax, 
             intframe->ebx, 
             intframe->ecx, 
@@ -57,8 +63,19 @@ void dispatch_irq(struct intframe_t *intframe)
             intframe->esi, 
             intframe->edi
         );
+        /*
+            A system call that has to wait leaves the registers as they are 
+            and moves back to the 'int' instruction, so that the process 
+            makes the same call again when it is woken up
+        */
+        if (get_running_process()->state == PROC_STATE_WAITING) {
+            intframe->eip -= SYSCALL_INSTRUCTION_SIZE;
+        } else {
+            intframe->eax = result;
+        }
         scheduler(intframe);
         break;
+    }
     default:
         kprintf("Unknown IRQ(%d - %d)\n", intframe->int_no, intframe->err_code);
     }
@@ -1,16 +1,41 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <cpuid.h>
 #include <kernel/lib/kassert.h>
 #include <kernel/memory/memory.h>
 #include <kernel/arch/i386/x86.h>
 #include <kernel/arch/i386/paging.h>
+#include <kernel/filesystems/pagecache.h>
+#include <klibc/string.h>
+
+
+#define CPUID_FEATURE_MTRR  (1 << 12)
+#define CPUID_FEATURE_PAT   (1 << 16)
+
+#define MSR_MTRRCAP             0xFE
+#define MSR_PAT                 0x277
+#define MSR_MTRR_DEF_TYPE       0x2FF
+#define MSR_MTRR_PHYSBASE(n)    (0x200 + 2 * (n))
+#define MSR_MTRR_PHYSMASK(n)    (0x201 + 2 * (n))
+
+#define MTRRCAP_VCNT            0xFF
+#define MTRRCAP_WC              (1 << 10)
+#define MTRR_DEF_TYPE_ENABLE    (1 << 11)
+#define MTRR_PHYSMASK_VALID     (1 << 11)
+
+#define MEMTYPE_WC              0x01
+// The PAT entry used by a page table entry with only PG_PAT set
+#define PAT_WC_ENTRY            4
+
+#define CR0_CACHEDISABLE        (1 << 30)
 
 
 static uint32_t npages;
 static struct PageInfo *pages;
 
 static pde_t *kern_pgdir;
+static bool pat_supported;
 
 /*
     The multiboot header contains a section to index which memory ranges are 
@@ -49,18 +74,115 @@ static void kern_pgdir_create(void)
         struct PageInfo *page = page_alloc(1);
         kassert(page != NULL);
         paddr_t pa = pageindex2pa((paddr_t) (page - pages));
+        // Only the memory that exists gets mapped, the rest must stay 0
+        memset((void *) pa, 0, PGSIZE);
         pgdir[i] = pa | PG_PRESENT | PG_USER | PG_RW;
     }
 
     kern_pgdir = pgdir;
 }
 
+/*
+    Programs the PAT so that PG_WRITECOMBINE selects write-combining. This 
+    is done before paging is enabled, when no mapping uses that entry
+*/
+static void pat_init(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & CPUID_FEATURE_PAT))
+        return;
+
+    uint64_t pat = rdmsr(MSR_PAT);
+    pat &= ~(0xffULL << (8 * PAT_WC_ENTRY));
+    pat |= (uint64_t) MEMTYPE_WC << (8 * PAT_WC_ENTRY);
+    wrmsr(MSR_PAT, pat);
+    wbinvd();
+    pat_supported = true;
+}
+
+/*
+    Returns the number of bits of a physical address, needed to build the 
+    masks of the MTRRs
+*/
+static int physical_address_bits(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000008, &eax, &ebx, &ecx, &edx))
+        return eax & 0xff;
+
+    return 36;
+}
+
+/*
+    Uses a free variable MTRR to make a physical range write-combining. 
+    The range is grown to a power of 2, which must be aligned.
+    Returns true on success
+*/
+static bool mtrr_writecombine(paddr_t pa, unsigned long size)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & CPUID_FEATURE_MTRR))
+        return false;
+    uint64_t cap = rdmsr(MSR_MTRRCAP);
+    if (!(cap & MTRRCAP_WC))
+        return false;
+
+    uint64_t length = PGSIZE;
+    while (length < size)
+        length *= 2;
+    if ((pa & (length - 1)) != 0)
+        return false;
+
+    int slot = -1;
+    for (int i = 0; i < (int) (cap & MTRRCAP_VCNT); i++) {
+        if (!(rdmsr(MSR_MTRR_PHYSMASK(i)) & MTRR_PHYSMASK_VALID)) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0)
+        return false;
+
+    uint64_t address_mask = (1ULL << physical_address_bits()) - 1;
+    uint64_t mask = (~(length - 1) & address_mask) | MTRR_PHYSMASK_VALID;
+
+    /*
+        The MTRRs are changed with the caches disabled and flushed, and 
+        with the MTRRs turned off, as the Intel manual asks
+    */
+    asm volatile("cli");
+    unsigned long cr0 = read_cr0();
+    load_cr0(cr0 | CR0_CACHEDISABLE);
+    wbinvd();
+    uint64_t def_type = rdmsr(MSR_MTRR_DEF_TYPE);
+    wrmsr(MSR_MTRR_DEF_TYPE, def_type & ~MTRR_DEF_TYPE_ENABLE);
+    wrmsr(MSR_MTRR_PHYSBASE(slot), pa | MEMTYPE_WC);
+    wrmsr(MSR_MTRR_PHYSMASK(slot), mask);
+    wrmsr(MSR_MTRR_DEF_TYPE, def_type);
+    wbinvd();
+    load_cr0(cr0);
+    asm volatile("sti");
+
+    return true;
+}
+
+uint16_t paging_writecombine(paddr_t pa, unsigned long size)
+{
+    if (pat_supported)
+        return PG_WRITECOMBINE;
+
+    mtrr_writecombine(pa, size);
+
+    return 0;
+}
+
 void paging_init(multiboot_info_t *mbh)
 {
     uint32_t total_memory = memory_get_total();
     npages = total_memory / PGSIZE;
     pages = (struct PageInfo *) boot_alloc(sizeof(struct PageInfo) * npages);
     multiboot_detect_available_pages(mbh);
+    pat_init();
     kern_pgdir_create();
     pgdir_map(kern_pgdir, 0, ROUNDUP(memory_get_total(), PGSIZE), 0, PG_PRESENT | PG_USER | PG_RW);
 }
@@ -69,7 +191,12 @@ void paging_load(pdir_t pgdir)
 {
     load_cr3((uint32_t) pgdir);
     unsigned long cr0 = read_cr0();
-    cr0 |= 0x80000001;
+    /*
+        Paging, write protect and protected mode. Programs run in ring 0, 
+        without write protect they could write to read only pages and copy 
+        on write would never fault
+    */
+    cr0 |= 0x80010001;
     load_cr0(cr0);
     // TODO: Invalidate TLB. This is important or this function will cause 
     // problems when called the second time!!!
@@ -84,7 +211,7 @@ pdir_t paging_kernel_pgdir()
     }
 }
 
-struct PageInfo *page_alloc(size_t count) {
+struct PageInfo *page_try_alloc(size_t count) {
     // TODO: This is terrible
     for (int i = 0; i < (int) (npages - (count-1)); i++) {
         bool valid = true;
@@ -105,6 +232,17 @@ struct PageInfo *page_alloc(size_t count) {
     return NULL;
 }
 
+struct PageInfo *page_alloc(size_t count) {
+    struct PageInfo *page;
+    // When memory runs out the page cache gives back the pages nobody uses
+    while ((page = page_try_alloc(count)) == NULL) {
+        if (pagecache_reclaim(count) == 0)
+            return NULL;
+    }
+
+    return page;
+}
+
 void page_free(struct PageInfo *page)
 {
     kassert(page->reserved == false);
@@ -117,14 +255,13 @@ pde_t *pgdir_create(void)
     kassert(page != NULL);
     pde_t *pgdir = (pde_t*) pageindex2pa((paddr_t) (page - pages));
 
-    const int kernel_page_end = KERNEL_END / PGSIZE;
-    for (int i = 0; i < kernel_page_end; i++) {
-        pgdir[i] = kern_pgdir[i];
-    }
-    for (int i = kernel_page_end; i < PGDIR_ENTRIES; i++) {
-        struct PageInfo *page = page_alloc(1);
-        kassert(page != NULL);
-        pgdir[i] = 0;
+    // The page tables of the mmap region are allocated when needed
+    for (int i = 0; i < PGDIR_ENTRIES; i++) {
+        if (i >= (int) PDX(MMAP_REGION_START) && i < (int) PDX(MMAP_REGION_END)) {
+            pgdir[i] = 0;
+        } else {
+            pgdir[i] = kern_pgdir[i];
+        }
     }
 
     return pgdir;
@@ -141,6 +278,24 @@ pte_t *pgdir_addr2entry(pdir_t pgdir, paddr_t va)
     return &table[PTX(va)];
 }
 
+pte_t *pgdir_walk(pdir_t pgdir, vaddr_t va)
+{
+    pte_t *entry = pgdir_addr2entry(pgdir, va);
+    if (entry != NULL) {
+        return entry;
+    }
+
+    struct PageInfo *page = page_alloc(1);
+    if (page == NULL) {
+        return NULL;
+    }
+    pte_t *table = (pte_t *) page2addr(page);
+    memset(table, 0, PGSIZE);
+    pgdir[PDX(va)] = (paddr_t) table | PG_PRESENT | PG_USER | PG_RW;
+
+    return &table[PTX(va)];
+}
+
 void 
 pgdir_map(
     pdir_t pgdir, 
@@ -160,4 +315,8 @@ pgdir_map(
 
 void *page2addr(struct PageInfo *page) {
     return (void *) pageindex2pa(page - pages);
-}
\ No newline at end of file
+}
+
+struct PageInfo *addr2page(void *addr) {
+    return &pages[(uint32_t) addr >> PGSHIFT];
+}
@@ -20,11 +20,26 @@
 #define PG_RW           0x2
 #define PG_PRESENT      0x1
 
-#define PG_GLOBAL       0x200
-#define PG_PAT          0x100
+/*
+    Bits of the error code of a page fault
+*/
+#define PF_PRESENT      0x1
+#define PF_WRITE        0x2
+#define PF_USER         0x4
+
+#define PG_GLOBAL       0x100
+// In a page table entry, the same bit is PG_PAGESIZE in a pgdir entry
+#define PG_PAT          0x80
 #define PG_DIRTY        0x40
 #define PG_CACHED       0x10
 
+/*
+    paging_init points the PAT entry selected by PG_PAT alone to the 
+    write-combining memory type, the other entries keep their default so 
+    PG_CACHEDISABLE and PG_WRITETHROUGH mean what they always did
+*/
+#define PG_WRITECOMBINE PG_PAT
+
 /*
     These macros are from the JOS Operating System.
 
@@ -67,19 +82,27 @@ bool page_available(struct PageInfo *page);
     Finds the first page in the 'pages' array that starts a contiguous area 
     of at least 'count' pages.
     Returns NULL if no area at least 'count' pages big was found, otherwise 
-    returns the pointer of the first page at the start of the area. 
+    returns the pointer of the first page at the start of the area. When no 
+    area is found the page cache is asked to free the pages it is not using 
+    before giving up.
 */
 struct PageInfo *page_alloc(size_t count);
 
+/*
+    Like page_alloc, but returns NULL right away instead of freeing pages 
+    of the page cache. For allocations that are only an optimization
+*/
+struct PageInfo *page_try_alloc(size_t count);
+
 /*
     Sets the argument page as available to be re-allocated
 */
 void page_free(struct PageInfo *page);
 
 /*
-    Returns a new page directory, where only the addresses under KERNEL_END
-    are mapped to the kernel. The rest of the addresses will have 0 in their 
-    pgdir entry.
+    Returns a new page directory that shares the kernel page tables, except 
+    for the mmap region (MMAP_REGION_START to MMAP_REGION_END) which has 
+    0 in its pgdir entries. Use pgdir_walk to map addresses there
 */
 pde_t *pgdir_create(void);
 
@@ -90,6 +113,12 @@ pde_t *pgdir_create(void);
 */
 pte_t *pgdir_addr2entry(pdir_t, paddr_t);
 
+/*
+    Like pgdir_addr2entry, but if there is no page table for the address a 
+    new empty one is allocated. Returns NULL if there is no memory for it
+*/
+pte_t *pgdir_walk(pdir_t, vaddr_t);
+
 /*
     Maps in a page directory all addresses in the ranges ['va' -> 'va+size'] 
     to ['pa' -> 'pa+size'] using the 'permissions' bits for each page table entry.
@@ -98,6 +127,16 @@ pte_t *pgdir_addr2entry(pdir_t, paddr_t);
 */
 void pgdir_map(pdir_t, uint32_t, unsigned long, uint32_t, uint16_t);
 
+/*
+    Makes the physical range ['pa' -> 'pa+size'] write-combining: writes to 
+    it are gathered and sent in bursts instead of one at a time, which is 
+    what a framebuffer wants. Returns the bits to add to the permissions 
+    given to pgdir_map for the range. When the CPU has no PAT the range is 
+    set up with a MTRR instead and the bits are 0, when neither works the 
+    range keeps its caching
+*/
+uint16_t paging_writecombine(paddr_t pa, unsigned long size);
+
 /*
     Loads the argument page directory and flushes the TLB. This also enables 
     paging, if it was not set already
@@ -115,6 +154,11 @@ pdir_t paging_kernel_pgdir();
 */
 void *page2addr(struct PageInfo *page);
 
+/*
+    Returns the page that contains the given address
+*/
+struct PageInfo *addr2page(void *addr);
+
 static inline uint32_t ROUNDUP(uint32_t value, uint32_t multiple)
 {
     if (value % multiple == 0)
@@ -28,6 +28,11 @@ static inline uint16_t inw(uint16_t port)
     return ret;
 }
 
+static inline void outw(uint16_t port, uint16_t val)
+{
+    asm volatile ( "outw %0, %1" : : "a"(val), "Nd"(port) );
+}
+
 static inline unsigned long read_cr0(void)
 {
     unsigned long val;
@@ -69,4 +74,50 @@ static inline void load_cr3(unsigned long cr3)
     );
 }
 
+static inline void invlpg(unsigned long addr)
+{
+    asm volatile ( "invlpg (%0)" : : "r"(addr) : "memory" );
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t low, high;
+    asm volatile ( "rdmsr" : "=a"(low), "=d"(high) : "c"(msr) );
+    return ((uint64_t) high << 32) | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    asm volatile ( 
+        "wrmsr" 
+        : 
+        : "c"(msr), "a"((uint32_t) value), "d"((uint32_t) (value >> 32)) 
+    );
+}
+
+/*
+    Disables the interrupts and returns the flags from before, to give to 
+    irq_restore. Unlike a plain sti, irq_restore leaves them disabled if 
+    they already were
+*/
+static inline uint32_t irq_save(void)
+{
+    uint32_t flags;
+    asm volatile ( "pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory" );
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+    asm volatile ( "push %0\n\tpopf" : : "r"(flags) : "memory", "cc" );
+}
+
+/*
+    Writes back all the modified cache lines and invalidates the caches
+*/
+static inline void wbinvd(void)
+{
+    asm volatile ( "wbinvd" : : : "memory" );
+}
+
 #endif
\ No newline at end of file
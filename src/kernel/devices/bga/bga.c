@@ -0,0 +1,36 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/arch/i386/x86.h>
+#include <kernel/devices/bga/bga.h>
+
+
+static uint16_t bga_read(uint16_t reg)
+{
+    outw(BGA_PORT_INDEX, reg);
+    return inw(BGA_PORT_DATA);
+}
+
+static void bga_write(uint16_t reg, uint16_t value)
+{
+    outw(BGA_PORT_INDEX, reg);
+    outw(BGA_PORT_DATA, value);
+}
+
+bool bga_available(void)
+{
+    uint16_t id = bga_read(BGA_REG_ID);
+
+    return id >= BGA_ID_VIRTUAL && id <= BGA_ID_LATEST;
+}
+
+int bga_set_virtual_height(int height)
+{
+    bga_write(BGA_REG_VIRT_HEIGHT, height);
+
+    return bga_read(BGA_REG_VIRT_HEIGHT);
+}
+
+void bga_set_y_offset(int y)
+{
+    bga_write(BGA_REG_Y_OFFSET, y);
+}
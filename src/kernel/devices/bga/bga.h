@@ -0,0 +1,49 @@
+#ifndef BGA_H
+#define BGA_H
+
+#include <stdbool.h>
+
+/*
+    The Bochs Graphics Adapter, the display device of Bochs and QEMU. Its 
+    registers are read and written through an index and a data port
+    See: https://wiki.osdev.org/Bochs_VBE_Extensions
+*/
+#define BGA_PORT_INDEX  0x01CE
+#define BGA_PORT_DATA   0x01CF
+
+enum {
+    BGA_REG_ID = 0, 
+    BGA_REG_XRES, 
+    BGA_REG_YRES, 
+    BGA_REG_BPP, 
+    BGA_REG_ENABLE, 
+    BGA_REG_BANK, 
+    BGA_REG_VIRT_WIDTH, 
+    BGA_REG_VIRT_HEIGHT, 
+    BGA_REG_X_OFFSET, 
+    BGA_REG_Y_OFFSET
+};
+
+// The first version with a virtual screen and display offsets
+#define BGA_ID_VIRTUAL  0xB0C1
+#define BGA_ID_LATEST   0xB0C5
+
+/*
+    Returns true if the adapter is there and supports a virtual screen 
+    bigger than the visible one
+*/
+bool bga_available(void);
+
+/*
+    Asks for a virtual screen 'height' rows tall. 
+    Returns the height the adapter set, which is lower when its memory is 
+    not enough
+*/
+int bga_set_virtual_height(int height);
+
+/*
+    Shows the part of the virtual screen that starts at row 'y'
+*/
+void bga_set_y_offset(int y);
+
+#endif
@@ -1,7 +1,10 @@
 #include <stdbool.h>
 #include <kernel/arch/i386/paging.h>
+#include <kernel/arch/i386/x86.h>
 #include <kernel/arch/multiboot.h>
 #include <kernel/devices/framebuffer.h>
+#include <kernel/devices/bga/bga.h>
+#include <kernel/lib/graphics/region.h>
 #include <kernel/lib/kassert.h>
 #include <kernel/lib/util.h>
 #include <kernel/memory/kheap.h>
@@ -10,6 +13,20 @@
 struct FrameBuffer main_buffer;
 struct FrameBuffer double_buffer;
 
+/*
+    When the display has room for two screens one is shown while the other 
+    is brought up to date, then they are swapped. main_buffer always points 
+    to the one that is shown. 'stale' is where each page is different from 
+    the double buffer, apart from the cursor which is taken away before 
+    the pages are swapped
+*/
+static struct {
+    bool enabled;
+    int front;
+    void *pages[2];
+    struct Region stale[2];
+} flip;
+
 int fb_init(multiboot_info_t *header)
 {
     pdir_t kernel_pgdir = paging_kernel_pgdir();
@@ -33,14 +50,34 @@ int fb_init(multiboot_info_t *header)
     }
 
     unsigned fb_size = main_buffer.pitch * main_buffer.height;
+    // The second page starts right after the first in video memory
+    flip.enabled = bga_available() && 
+        bga_set_virtual_height(2 * main_buffer.height) >= 2 * main_buffer.height;
+    flip.front = 0;
+    flip.pages[0] = main_buffer.addr;
+    flip.pages[1] = main_buffer.addr + fb_size;
+    region_clear(&flip.stale[0]);
+    region_clear(&flip.stale[1]);
+
+    const paddr_t fb_start = ROUNDDOWN((uint32_t) main_buffer.addr, PGSIZE);
+    const unsigned long fb_pages_size = ROUNDUP(
+        (flip.enabled ? 2 : 1) * fb_size + PGOFF(main_buffer.addr), PGSIZE
+    );
 
+    /*
+        The screen is only ever written to in long runs of pixels, so writes 
+        are combined instead of going to video memory one at a time
+    */
+    uint16_t caching = paging_writecombine(fb_start, fb_pages_size);
     pgdir_map(
         kernel_pgdir, 
-        ROUNDDOWN((uint32_t) main_buffer.addr, PGSIZE), 
-        ROUNDUP(fb_size, PGSIZE), 
-        ROUNDDOWN((uint32_t) main_buffer.addr, PGSIZE), 
-        PG_PRESENT | PG_USER | PG_RW
+        fb_start, 
+        fb_pages_size, 
+        fb_start, 
+        PG_PRESENT | PG_USER | PG_RW | caching
     );
+    for (unsigned long i = 0; i < fb_pages_size; i += PGSIZE)
+        invlpg(fb_start + i);
 
     void *allocated = kmalloc(fb_size);
     if (allocated == NULL) {
@@ -49,6 +86,8 @@ int fb_init(multiboot_info_t *header)
     }
     double_buffer = main_buffer;
     double_buffer.addr = allocated;
+    if (flip.enabled)
+        bga_set_y_offset(0);
 
     return 0;
 }
@@ -60,12 +99,22 @@ struct FrameBuffer *fb_alloc(int width, int height)
     if (addr == NULL) {
         return NULL;
     }
-    struct FrameBuffer *fb = kmalloc(sizeof(struct FrameBuffer));
+    struct FrameBuffer *fb = fb_wrap(addr, width, height);
     if (fb == NULL) {
         kfree(addr);
         return NULL;
     }
 
+    return fb;
+}
+
+struct FrameBuffer *fb_wrap(void *addr, int width, int height)
+{
+    struct FrameBuffer *fb = kmalloc(sizeof(struct FrameBuffer));
+    if (fb == NULL) {
+        return NULL;
+    }
+
     fb->bytesPerPixel = main_buffer.bytesPerPixel;
     fb->addr = addr;
     fb->width = width;
@@ -82,38 +131,136 @@ void fb_free(struct FrameBuffer *fb)
     kfree(fb);
 }
 
+bool fb_clip(struct FrameBuffer *fb, int *x, int *y, int *width, int *height)
+{
+    if (*x < 0) {
+        *width += *x;
+        *x = 0;
+    }
+    if (*y < 0) {
+        *height += *y;
+        *y = 0;
+    }
+    *width = MIN(*width, fb->width - *x);
+    *height = MIN(*height, fb->height - *y);
+
+    return *width > 0 && *height > 0;
+}
+
+void fb_copy_pixels(uint32_t *dest, const uint32_t *src, int count)
+{
+    asm volatile("rep movsl" 
+        : "+D"(dest), "+S"(src), "+c"(count) : : "memory");
+}
+
+/*
+    Mixes 'src' over 'dst', 'alpha' being how much 'src' covers it. Red 
+    and blue are computed together with a single multiplication, as 
+    they have 8 free bits between them, then green.
+    x / 255 is computed as (x + (x >> 8) + 1) >> 8, exact for 0 to 65535
+*/
+static inline uint32_t blend_pixel(uint32_t src, uint32_t dst, uint32_t alpha)
+{
+    const uint32_t inverse = 255 - alpha;
+    uint32_t rb = (src & 0xff00ff) * alpha + (dst & 0xff00ff) * inverse;
+    uint32_t g = (src & 0x00ff00) * alpha + (dst & 0x00ff00) * inverse;
+    rb = ((rb + ((rb >> 8) & 0xff00ff) + 0x010001) >> 8) & 0xff00ff;
+    g = ((g + ((g >> 8) & 0x00ff00) + 0x000100) >> 8) & 0x00ff00;
+
+    return rb | g;
+}
+
+void fb_blend_pixels(
+    uint32_t *dest, const uint32_t *src, int count, 
+    uint8_t opacity, bool use_alpha
+)
+{
+    if (!use_alpha) {
+        for (int i = 0; i < count; i++)
+            dest[i] = blend_pixel(src[i], dest[i], opacity);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        // The pixels that are fully opaque or fully transparent are common
+        const uint32_t alpha = (src[i] >> 24) * opacity / 255;
+        if (alpha == 255)
+            dest[i] = src[i] & 0xffffff;
+        else if (alpha != 0)
+            dest[i] = blend_pixel(src[i], dest[i], alpha);
+    }
+}
+
+void fb_fill_pixels(uint32_t *dest, uint32_t value, int count)
+{
+    asm volatile("rep stosl" 
+        : "+D"(dest), "+c"(count) : "a"(value) : "memory");
+}
+
 void fb_blit(
     struct FrameBuffer *dest, struct FrameBuffer *src, 
     int x, int y, int width, int height
 )
 {
-    /*
-        TODO: Rewrite this to avoid checking IFs at every iteration. 
-        This is terrible
-    */
-    const int screenw = dest->width;
-    const int screenh = dest->height;
-    uint32_t *fb_dest = (uint32_t *) (dest->addr + y * dest->pitch);
-    uint32_t *fb_src = (uint32_t *) src->addr;
+    width = MIN(width, src->width);
+    height = MIN(height, src->height);
+    const int from_x = x, from_y = y;
+    if (!fb_clip(dest, &x, &y, &width, &height))
+        return;
 
+    char *fb_dest = dest->addr + fb_offset(dest, x, y);
+    char *fb_src = src->addr + fb_offset(src, x - from_x, y - from_y);
     for (int i = 0; i < height; i++) {
-        if (y+i >= screenh)
-            break;
-        if (y+i >= 0) {
-            for (int j = 0; j < width; j++) {
-                if (x+j < 0)
-                    continue;
-                if (x+j >= screenw)
-                    break;
-
-                fb_dest[x+j] = fb_src[j];
-            }
-        }
-        MOVE_PTR(fb_dest, uint32_t, dest->pitch);
-        MOVE_PTR(fb_src, uint32_t, src->pitch);
+        fb_copy_pixels((uint32_t *) fb_dest, (uint32_t *) fb_src, width);
+        fb_dest += dest->pitch;
+        fb_src += src->pitch;
+    }
+}
+
+void fb_blend(
+    struct FrameBuffer *dest, struct FrameBuffer *src, 
+    int x, int y, int width, int height, 
+    uint8_t opacity, bool use_alpha
+)
+{
+    if (opacity == 255 && !use_alpha) {
+        fb_blit(dest, src, x, y, width, height);
+        return;
+    }
+
+    width = MIN(width, src->width);
+    height = MIN(height, src->height);
+    const int from_x = x, from_y = y;
+    if (opacity == 0 || !fb_clip(dest, &x, &y, &width, &height))
+        return;
+
+    char *fb_dest = dest->addr + fb_offset(dest, x, y);
+    char *fb_src = src->addr + fb_offset(src, x - from_x, y - from_y);
+    for (int i = 0; i < height; i++) {
+        fb_blend_pixels((uint32_t *) fb_dest, (uint32_t *) fb_src, width, opacity, use_alpha);
+        fb_dest += dest->pitch;
+        fb_src += src->pitch;
     }
 }
 
+int fb_view(
+    struct FrameBuffer *fb, 
+    int x, int y, int width, int height, 
+    struct FrameBuffer *view
+)
+{
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || 
+            x + width > fb->width || y + height > fb->height)
+        return -1;
+
+    *view = *fb;
+    view->addr = fb->addr + fb_offset(fb, x, y);
+    view->width = width;
+    view->height = height;
+
+    return 0;
+}
+
 struct FrameBuffer *get_screen_framebuffer(void)
 {
     return &double_buffer;
@@ -134,39 +281,62 @@ int screen_height(void)
     return main_buffer.height;
 }
 
+/*
+    Copies an area, already clipped to the screen, from the double buffer 
+    to 'page'
+*/
+static void screen_copy(void *page, int x, int y, int width, int height)
+{
+    const unsigned offset = fb_offset(&main_buffer, x, y);
+    char *mainb = page + offset;
+    char *doubleb = double_buffer.addr + offset;
+    for (int i = 0; i < height; i++) {
+        fb_copy_pixels((uint32_t *) mainb, (uint32_t *) doubleb, width);
+        mainb += main_buffer.pitch;
+        doubleb += double_buffer.pitch;
+    }
+}
+
 void screen_update(int x, int y, int width, int height)
 {
-    uint32_t *mainb = (uint32_t *) main_buffer.addr;
-    uint32_t *doubleb = (uint32_t *) double_buffer.addr;
-    const int bpp = main_buffer.bytesPerPixel;
-    const unsigned offset = y * main_buffer.pitch + x * bpp;
-    
-    const int screenw = screen_width();
-    const int screenh = screen_height();
+    if (!fb_clip(&main_buffer, &x, &y, &width, &height))
+        return;
 
-    MOVE_PTR(mainb, uint32_t, offset);
-    MOVE_PTR(doubleb, uint32_t, offset);
+    screen_copy(main_buffer.addr, x, y, width, height);
+    // The page that is not shown is now behind the double buffer there
+    if (flip.enabled)
+        region_add(&flip.stale[!flip.front], &(struct Rect) {x, y, width, height});
+}
 
-    /*
-        TODO: Optimize this, all those IFs are terrible for performance
-    */
-    for (int i = 0; i < height; i++) {
-        if (y + i >= screenh)
-            break;
-        
-        if (y + i >= 0) {
-            for (int j = 0; j < width; j++) {
-                if (x + j < 0)
-                    continue;
-                if (x + j >= screenw)
-                    break;
-
-                mainb[j] = doubleb[j];
-            }
+bool screen_present(const struct Region *damage)
+{
+    if (region_is_empty(damage))
+        return false;
+
+    if (!flip.enabled) {
+        for (int i = 0; i < damage->count; i++) {
+            const struct Rect *r = &damage->rects[i];
+            screen_update(r->x, r->y, r->width, r->height);
         }
-        MOVE_PTR(mainb, uint32_t, main_buffer.pitch);
-        MOVE_PTR(doubleb, uint32_t, double_buffer.pitch);
+        return false;
     }
+
+    const int back = !flip.front;
+    struct Region *stale = &flip.stale[back];
+    region_union(stale, damage);
+    for (int i = 0; i < stale->count; i++) {
+        struct Rect r = stale->rects[i];
+        if (fb_clip(&main_buffer, &r.x, &r.y, &r.width, &r.height))
+            screen_copy(flip.pages[back], r.x, r.y, r.width, r.height);
+    }
+    region_clear(stale);
+    region_union(&flip.stale[flip.front], damage);
+
+    bga_set_y_offset(back * main_buffer.height);
+    flip.front = back;
+    main_buffer.addr = flip.pages[back];
+
+    return true;
 }
 
 void screen_refresh(void)
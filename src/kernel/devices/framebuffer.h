@@ -2,7 +2,9 @@
 #define FRAMEBUFFER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <kernel/arch/multiboot.h>
+#include <kernel/lib/graphics/region.h>
 
 
 struct FrameBuffer {
@@ -16,20 +18,74 @@ int fb_init(multiboot_info_t *header);
 
 struct FrameBuffer *fb_alloc(int width, int height);
 
+/*
+    Returns a framebuffer of 'width' by 'height' pixels that uses the memory 
+    at 'addr', which is not freed with it: use kfree instead of fb_free. 
+    The rows are packed one after the other. NULL if there is no memory
+*/
+struct FrameBuffer *fb_wrap(void *addr, int width, int height);
+
 void fb_free(struct FrameBuffer *fb);
 
 /*
     Copies an area from the 'src' framebuffer to the 'dest' framebuffer. 
     The area is defined as a rectangle from the 'src' framebuffer that is
-    copied as a whole, with no transformations
-
-    TODO: Allow to copy out-of-bounds
+    copied as a whole, with no transformations. The parts that end up 
+    outside of 'dest' are not copied
 */
 void fb_blit(
     struct FrameBuffer *dest, struct FrameBuffer *src, 
     int x, int y, int width, int height
 );
 
+/*
+    Like fb_blit, but the pixels of 'src' are mixed with the ones below 
+    them: each one covers them by 'opacity' (0 to 255) times its own alpha, 
+    the highest byte of the color, when 'use_alpha' is true. Without 
+    'use_alpha' the alpha byte is ignored
+*/
+void fb_blend(
+    struct FrameBuffer *dest, struct FrameBuffer *src, 
+    int x, int y, int width, int height, 
+    uint8_t opacity, bool use_alpha
+);
+
+/*
+    Shrinks the rectangle x, y, width, height to the part of it inside 'fb'.
+    Returns false if nothing is left
+*/
+bool fb_clip(struct FrameBuffer *fb, int *x, int *y, int *width, int *height);
+
+/*
+    Copies a row of 'count' pixels, 4 bytes at a time
+*/
+void fb_copy_pixels(uint32_t *dest, const uint32_t *src, int count);
+
+/*
+    Mixes a row of 'count' pixels of 'src' over 'dest', see fb_blend
+*/
+void fb_blend_pixels(
+    uint32_t *dest, const uint32_t *src, int count, 
+    uint8_t opacity, bool use_alpha
+);
+
+/*
+    Sets a row of 'count' pixels to the same value, 4 bytes at a time
+*/
+void fb_fill_pixels(uint32_t *dest, uint32_t value, int count);
+
+/*
+    Makes 'view' a framebuffer that shares the pixels of the area of 'fb' 
+    at x, y of the given size: drawing on it at 0, 0 draws on 'fb' at x, y, 
+    and nothing outside the area is ever touched. Used to clip drawing.
+    Returns 0 on success, -1 if the area is not completely inside 'fb'
+*/
+int fb_view(
+    struct FrameBuffer *fb, 
+    int x, int y, int width, int height, 
+    struct FrameBuffer *view
+);
+
 /*
     Returns the framebuffer used for doublebuffering. 
     In doubt, use this
@@ -58,6 +114,16 @@ int screen_height(void);
 */
 void screen_update(int x, int y, int width, int height);
 
+/*
+    Shows on the screen the areas of the double buffer in 'damage', all 
+    at once. When the display has room for two screens the hidden one is 
+    brought up to date and then shown in place of the other, so a frame is 
+    never seen half drawn. 
+    Returns true if the screen was swapped: what was drawn straight on the 
+    main framebuffer is not shown anymore, see cursor_hide
+*/
+bool screen_present(const struct Region *damage);
+
 /*
     Updates the whole screen. This is equivalent to calling 
     screen_update(0, 0, screen_width(), screen_height())
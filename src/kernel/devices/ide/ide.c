@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <kernel/lib/kassert.h>
 #include <kernel/lib/kprintf.h>
+#include <kernel/lib/util.h>
 #include <kernel/arch/i386/x86.h>
 #include <kernel/memory/kheap.h>
 #include <kernel/devices/ide/ide.h>
@@ -10,6 +11,7 @@
 #include <kernel/memory/kheap.h>
 #include <kernel/devices/timer/timer.h>
 #include <kernel/devices/vdisk.h>
+#include <kernel/lib/iovec.h>
 
 
 /* Parts of this code is adapted from the Protura OS
@@ -49,6 +51,18 @@ static void ide_do_pio_read(uint16_t *buf)
     }
 }
 
+/*
+    Writes a single sector from the buffer using PIO. The buffer is expected 
+    to be at least ATA_SECTOR_SIZE bytes long (usually 512 bytes)
+*/
+static void ide_do_pio_write(uint16_t *buf)
+{
+    const int sector_writes = IDE_SECTOR_SIZE / sizeof(uint16_t);
+    for (int i = 0; i < sector_writes; i++) {
+        outw(IDE_PORT_DATA, buf[i]);
+    }
+}
+
 /*
     For some reason in the IDENTIFY ide data block the model string 
     is written with each 2 characters swapped: for example
@@ -115,28 +129,93 @@ int ide_identify_master(struct ide_identify_format *response)
 }
 
 // TODO: ide_identify_slave
+/*
+    Reads 'count' consecutive sectors starting from 'sector' in the buffer 
+    with a single command. 'count' must be between 1 and 
+    IDE_MAX_SECTORS_PER_COMMAND. If 'slave' is true then the sectors will be 
+    read from the slave device, otherwise from the master.
+    This is blocking since it uses PIO read
+    Returns 0 on success, -1 otherwise
+*/
+static int ide_readsects(int sector, int count, bool slave, uint16_t *buffer)
+{
+    kassert(count > 0 && count <= IDE_MAX_SECTORS_PER_COMMAND);
+
+    outb(IDE_PORT_DRIVE_HEAD, 
+        IDE_DH_SHOULD_BE_SET | IDE_DH_LBA | 
+        (slave ? IDE_DH_SLAVE : 0) | ((sector >> 24) & 0x0F));
+    outb(IDE_PORT_SECTOR_CNT, count);
+    outb(IDE_PORT_LBA_LOW_8, (sector) & 0xFF);
+    outb(IDE_PORT_LBA_MID_8, (sector >> 8) & 0xFF);
+    outb(IDE_PORT_LBA_HIGH_8, (sector >> 16) & 0xFF);
+    outb(IDE_PORT_COMMAND_STATUS, IDE_COMMAND_PIO_LBA28_READ);
+
+    // The drive raises DATA_REQUEST again before each sector
+    for (int i = 0; i < count; i++) {
+        int status = ide_wait_for_status(IDE_STATUS_DATA_REQUEST, IDE_READSTATUS_TIMEOUT);
+        if (status == IDE_STATUS_TIMEOUT || status & (IDE_STATUS_ERROR | IDE_STATUS_DRIVE_FAULT)) {
+            return -1;
+        }
+        ide_do_pio_read(buffer);
+        buffer += IDE_SECTOR_SIZE / sizeof(uint16_t);
+    }
+
+    return 0;
+}
+
 /*
     Reads a single sector in the buffer. If 'slave' is true then the sector 
     will be read from the slave device, otherwise from the master.
-    This is blocking since it uses PIO read
     Returns 0 on success, -1 otherwise
 */
 static int ide_readsect(int sector, bool slave, uint16_t *buffer)
+{
+    return ide_readsects(sector, 1, slave, buffer);
+}
+
+/*
+    Starts a PIO write of 'count' sectors from 'sector'. The data of each 
+    sector is then sent with ide_write_data and ide_write_done waits for 
+    the drive to finish. 'count' can be at most IDE_MAX_SECTORS_PER_COMMAND
+*/
+static void ide_write_command(int sector, int count, bool slave)
 {
     outb(IDE_PORT_DRIVE_HEAD, 
         IDE_DH_SHOULD_BE_SET | IDE_DH_LBA | 
         (slave ? IDE_DH_SLAVE : 0) | ((sector >> 24) & 0x0F));
-    outb(IDE_PORT_SECTOR_CNT, 1);
+    outb(IDE_PORT_SECTOR_CNT, count);
     outb(IDE_PORT_LBA_LOW_8, (sector) & 0xFF);
     outb(IDE_PORT_LBA_MID_8, (sector >> 8) & 0xFF);
     outb(IDE_PORT_LBA_HIGH_8, (sector >> 16) & 0xFF);
-    outb(IDE_PORT_COMMAND_STATUS, IDE_COMMAND_PIO_LBA28_READ);
+    outb(IDE_PORT_COMMAND_STATUS, IDE_COMMAND_PIO_LBA28_WRITE);
+}
 
+/*
+    Sends the data of the next sector of a write started with 
+    ide_write_command, waiting for the drive to ask for it.
+    Returns 0 on success, -1 otherwise
+*/
+static int ide_write_data(uint16_t *buffer)
+{
+    int status = ide_wait_for_status(IDE_STATUS_DATA_REQUEST, IDE_READSTATUS_TIMEOUT);
+    if (status == IDE_STATUS_TIMEOUT || status & (IDE_STATUS_ERROR | IDE_STATUS_DRIVE_FAULT)) {
+        return -1;
+    }
+    ide_do_pio_write(buffer);
+
+    return 0;
+}
+
+/*
+    Waits for the drive to be done with the data before the next command.
+    Returns 0 on success, -1 otherwise
+*/
+static int ide_write_done(void)
+{
     int status = ide_wait_for_status(0, IDE_READSTATUS_TIMEOUT);
-    if ((status & IDE_STATUS_READY) == 0 || status == IDE_STATUS_TIMEOUT) {
+    if (status == IDE_STATUS_TIMEOUT || status & (IDE_STATUS_ERROR | IDE_STATUS_DRIVE_FAULT)) {
         return -1;
     }
-    ide_do_pio_read(buffer);
 
     return 0;
 }
@@ -146,6 +225,9 @@ static int ide_readsect(int sector, bool slave, uint16_t *buffer)
     DiskInterface struct that is used to implement a generic disk. 
     This reads an array of bytes in the disk considering an offset at the 
     start of the disk and a size, writing it in buffer. 
+    Whole sectors are read directly into 'buffer', many at a time, only the 
+    partial sectors at the start and at the end go through a temporary 
+    sector buffer.
     Returns 0 on success, otherwise the result of readsect
 */
 static int __ide_read_bytes(int offset, int count, char *buffer)
@@ -153,20 +235,21 @@ static int __ide_read_bytes(int offset, int count, char *buffer)
     char sector_buffer[IDE_SECTOR_SIZE];
     while (count > 0) {
         int sector = offset / IDE_SECTOR_SIZE;
-        int result = ide_readsect(sector, false, (uint16_t *) sector_buffer);
+        int sector_offset = offset % IDE_SECTOR_SIZE;
+        int bytes_to_copy;
+        int result;
+        if (sector_offset == 0 && count >= IDE_SECTOR_SIZE) {
+            int sectors = MIN(count / IDE_SECTOR_SIZE, IDE_MAX_SECTORS_PER_COMMAND);
+            result = ide_readsects(sector, sectors, false, (uint16_t *) buffer);
+            bytes_to_copy = sectors * IDE_SECTOR_SIZE;
+        } else {
+            result = ide_readsect(sector, false, (uint16_t *) sector_buffer);
+            bytes_to_copy = MIN(IDE_SECTOR_SIZE - sector_offset, count);
+            memcpy(buffer, &sector_buffer[sector_offset], bytes_to_copy);
+        }
         if (result != 0) {
             return result;
         }
-        int bytes_to_sector_end = IDE_SECTOR_SIZE - ( (offset+count) % IDE_SECTOR_SIZE);
-        int bytes_to_copy = bytes_to_sector_end;
-        if (bytes_to_sector_end > count) {
-            bytes_to_copy = count;
-        }
-        memcpy(
-            buffer, 
-            &sector_buffer[offset % IDE_SECTOR_SIZE], 
-            bytes_to_copy
-        );
 
         count -= bytes_to_copy;
         buffer += bytes_to_copy;
@@ -177,14 +260,85 @@ static int __ide_read_bytes(int offset, int count, char *buffer)
 }
 
 /*
-    TODO: Implement this. 
+    This function is used to implement the write_bytesv call in the 
+    DiskInterface struct. The segments are written one after the other from 
+    'offset', as a single area of the disk, many sectors for each command. 
+    Whole sectors that lie inside one segment are sent straight from it, the 
+    others are put together in a sector buffer. The sectors at the edges 
+    that are only partially written are read first so that the bytes around 
+    the written area are preserved. The drive write cache is flushed at the 
+    end.
+    Returns 0 on success, -1 if reading or writing a sector failed
+*/
+static int __ide_write_bytesv(int offset, struct IOVec *iov, int count)
+{
+    const int total = iovec_length(iov, count);
+    if (total == 0)
+        return 0;
+    const int end = offset + total;
+    const int first = offset / IDE_SECTOR_SIZE;
+    const int last = (end - 1) / IDE_SECTOR_SIZE;
+
+    char head[IDE_SECTOR_SIZE], tail[IDE_SECTOR_SIZE], sector_buffer[IDE_SECTOR_SIZE];
+    // When the write is inside a single sector 'head' is used for both edges
+    char *last_buffer = first == last ? head : tail;
+    if (offset % IDE_SECTOR_SIZE != 0 || (first == last && end % IDE_SECTOR_SIZE != 0)) {
+        if (ide_readsect(first, false, (uint16_t *) head) != 0)
+            return -1;
+    }
+    if (first != last && end % IDE_SECTOR_SIZE != 0) {
+        if (ide_readsect(last, false, (uint16_t *) tail) != 0)
+            return -1;
+    }
+
+    struct IOCursor cursor;
+    iocursor_init(&cursor, iov, count);
+    for (int sector = first; sector <= last; ) {
+        const int sectors = MIN(last - sector + 1, IDE_MAX_SECTORS_PER_COMMAND);
+        ide_write_command(sector, sectors, false);
+        for (int i = 0; i < sectors; i++, sector++) {
+            const int sector_start = sector * IDE_SECTOR_SIZE;
+            const int from = MAX(offset, sector_start) - sector_start;
+            const int to = MIN(end, sector_start + IDE_SECTOR_SIZE) - sector_start;
+
+            uint16_t *data;
+            if (from == 0 && to == IDE_SECTOR_SIZE && 
+                    iocursor_contiguous(&cursor) >= IDE_SECTOR_SIZE) {
+                data = (uint16_t *) iocursor_ptr(&cursor);
+                iocursor_skip(&cursor, IDE_SECTOR_SIZE);
+            } else {
+                char *buffer = sector_buffer;
+                if (sector == first)
+                    buffer = head;
+                else if (sector == last)
+                    buffer = last_buffer;
+                iocursor_copy(&cursor, buffer + from, to - from);
+                data = (uint16_t *) buffer;
+            }
+            if (ide_write_data(data) != 0)
+                return -1;
+        }
+        if (ide_write_done() != 0)
+            return -1;
+    }
+
+    outb(IDE_PORT_COMMAND_STATUS, IDE_COMMAND_CACHE_FLUSH);
+    if (ide_wait_for_status(0, IDE_READSTATUS_TIMEOUT) == IDE_STATUS_TIMEOUT)
+        return -1;
+
+    return 0;
+}
+
+/*
+    This function is used to implement the write_bytes call in the 
+    DiskInterface struct, it is a write of a single segment.
+    Returns 0 on success, -1 if reading or writing a sector failed
 */
 static int __ide_write_bytes(int offset, int count, char *buffer)
 {
-    (void) offset;
-    (void) count;
-    (void) buffer;
-    return -1;
+    struct IOVec segment = { .base = buffer, .length = count };
+
+    return __ide_write_bytesv(offset, &segment, 1);
 }
 
 int ide_get_diskinterface(struct DiskInterface *interface)
@@ -193,6 +347,7 @@ int ide_get_diskinterface(struct DiskInterface *interface)
         return -1;
     interface->read_bytes = &__ide_read_bytes;
     interface->write_bytes = &__ide_write_bytes;
+    interface->write_bytesv = &__ide_write_bytesv;
 
     return 0;
 }
@@ -8,6 +8,8 @@
 
 #define IDE_SECTOR_SIZE     512
 #define IDE_READSTATUS_TIMEOUT  40
+// The sector count register is 8 bits wide (0 would mean 256)
+#define IDE_MAX_SECTORS_PER_COMMAND 255
 
 /*
     Parts of this code is copied/adapted from the Protura OS
@@ -124,8 +126,8 @@ struct ide_identify_format {
 int ide_identify_master(struct ide_identify_format *);
 
 /*
-    TODO: docs for this
-    TODO: write_bytes
+    Fills a DiskInterface struct to read and write the master IDE device. 
+    Returns 0 on success, -1 if 'interface' is NULL
 */
 int ide_get_diskinterface(struct DiskInterface *interface);
 
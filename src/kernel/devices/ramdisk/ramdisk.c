@@ -29,6 +29,7 @@ int ramdisk_get_diskinterface(struct DiskInterface *interface)
     
     interface->read_bytes = &read_bytes;
     interface->write_bytes = &write_bytes;
+    interface->write_bytesv = &write_bytesv;
 
     return 0;
 }
@@ -62,4 +63,22 @@ int write_bytes(int offset, int count, char *buffer)
     memcpy(ramdisk + offset, buffer, count);
 
     return 0;
-}
\ No newline at end of file
+}
+
+/*
+    Writes the segments one after the other in the ramdisk, starting from 
+    'offset'.
+    Returns 0 on success, -1 if the offset or the total size is not valid
+*/
+int write_bytesv(int offset, struct IOVec *iov, int count)
+{
+    if (offset < 0 || offset + iovec_length(iov, count) > ramdisk_size)
+        return -1;
+
+    for (int i = 0; i < count; i++) {
+        memcpy(ramdisk + offset, iov[i].base, iov[i].length);
+        offset += iov[i].length;
+    }
+
+    return 0;
+}
@@ -7,5 +7,6 @@ int ramdisk_init(char *disk, int size);
 int ramdisk_get_diskinterface(struct DiskInterface *interface);
 int read_bytes(int offset, int count, char *buffer);
 int write_bytes(int offset, int count, char *buffer);
+int write_bytesv(int offset, struct IOVec *iov, int count);
 
 #endif
\ No newline at end of file
@@ -52,4 +52,14 @@ int serial_write(const char *data)
     }
     
     return 0;
-}
\ No newline at end of file
+}
+
+int serial_write_bytes(const char *data, int size)
+{
+    for (int i = 0; i < size; i++) {
+        if (serial_writechar(data[i]) != 0)
+            return -1;
+    }
+    
+    return 0;
+}
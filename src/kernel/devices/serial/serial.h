@@ -16,6 +16,14 @@ void serial_init(void);
 */
 int serial_write(const char *data);
 
+/*
+    Writes 'size' bytes from 'data' to the serial console, the data can 
+    contain null bytes.
+    Returns 0 on success, -1 if a timeout occurs while waiting for the 
+    serial device to be ready
+*/
+int serial_write_bytes(const char *data, int size);
+
 // int serial_read(char *buffer, size_t size);
 
 enum {
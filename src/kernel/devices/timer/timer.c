@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <kernel/arch/i386/x86.h>
 #include <kernel/devices/timer/timer.h>
+#include <kernel/process.h>
 
 
 uint32_t ticks = 0;
@@ -19,10 +20,24 @@ uint32_t timer_get_ticks()
 void __timer_tick()
 {
     ticks++;
+    // The sleeping processes check again if their time has come
+    process_wakeup(&ticks);
+}
+
+bool timer_wait_until(uint32_t tick)
+{
+    if ((int32_t) (ticks - tick) >= 0)
+        return false;
+
+    process_wait(&ticks);
+
+    return true;
 }
 
 
 static uint16_t div;
+// What was actually written to the PIT, 0 stands for 65536
+static uint16_t pit_divisor;
 /*
     Sets the timer to send an interrupt every 'milliseconds' ms. Note that 
     it is not accurate
@@ -35,7 +50,8 @@ void timer_init(uint16_t frequency)
         this we can send a number to divide this frequency. 
         See: https://wiki.osdev.org/Programmable_Interval_Timer
     */
-    uint32_t divisor = 1193182 / frequency;
+    uint32_t divisor = PIT_FREQUENCY / frequency;
+    pit_divisor = divisor & 0xffff;
 
     outb(0x43, 0x36);
     outb(0x40, (uint8_t) (divisor & 0xff));
@@ -45,4 +61,9 @@ void timer_init(uint16_t frequency)
 uint16_t timer_get_divisor(void)
 {
     return div;
+}
+
+uint32_t timer_frequency(void)
+{
+    return PIT_FREQUENCY / (pit_divisor == 0 ? 65536 : pit_divisor);
 }
\ No newline at end of file
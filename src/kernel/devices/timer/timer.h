@@ -1,6 +1,12 @@
 #ifndef TIMER_H
 #define TIMER_R
 
+#include <stdint.h>
+#include <stdbool.h>
+
+// The frequency of the oscillator of the PIT, in Hz
+#define PIT_FREQUENCY   1193182
+
 void timer_init(uint16_t);
 
 /*
@@ -11,4 +17,17 @@ uint16_t timer_get_divisor(void);
 uint32_t timer_get_ticks();
 void __timer_tick();
 
+/*
+    Returns how many ticks happen in a second, as the PIT was programmed
+*/
+uint32_t timer_frequency(void);
+
+/*
+    If the tick count has not reached 'tick' yet the running process waits 
+    until the next tick, see process_wait, and true is returned. A system 
+    call that waits this way is made again at every tick until the time 
+    comes
+*/
+bool timer_wait_until(uint32_t tick);
+
 #endif
\ No newline at end of file
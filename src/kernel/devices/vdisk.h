@@ -1,9 +1,17 @@
 #ifndef VDISK_H
 #define VDISK_H
 
+#include <kernel/lib/iovec.h>
+
 struct DiskInterface{
     int (*read_bytes)(int, int, char *);
     int (*write_bytes)(int, int, char *);
+    /*
+        Optional. Writes the segments one after the other starting from the 
+        offset on the disk, as a single write. NULL if the disk does not 
+        support it, write_bytes is called for each segment instead
+    */
+    int (*write_bytesv)(int, struct IOVec *, int);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,21 +3,15 @@
 #include <stddef.h>
 #include <kernel/devices/vdisk.h>
 #include <kernel/lib/kassert.h>
+#include <kernel/lib/time.h>
+#include <kernel/lib/util.h>
+#include <kernel/memory/kheap.h>
 #include <klibc/string.h>
 #include <klibc/ctype.h>
 #include <kernel/filesystems/vfs.h>
 #include <kernel/filesystems/fat16/fat16.h>
 
 
-static FAT16FileSystem fs;
-static struct DiskInterface *disk;
-static int CLUSTER_SIZE;
-
-void fat16_set_diskinterface(struct DiskInterface *diskinterface)
-{
-    disk = diskinterface;
-}
-
 int fat16_is_entry_end(FAT16DirEntry *entry) {
     return *((char *) entry) == 0x00;
 }
@@ -34,8 +28,8 @@ int fat16_is_entry_lfn(FAT16DirEntry *entry) {
     Returns the offset in bytes in the data region of the disk of the given 
     cluster
 */
-int fat16_cluster_to_offset(int cluster) {
-    return (cluster-2) * CLUSTER_SIZE;
+int fat16_cluster_to_offset(FAT16FileSystem *fs, int cluster) {
+    return (cluster-2) * fs->clusterSize;
 }
 
 int fat16_get_formatted_filename(unsigned char *fatfilename, unsigned char *filename)
@@ -63,17 +57,206 @@ int fat16_get_formatted_filename(unsigned char *fatfilename, unsigned char *file
 
 /*
     Reads the given cluster from disk and stores it in buffer. 'buffer' is 
-    expected to be at least CLUSTER_SIZE bytes long
+    expected to be at least fs->clusterSize bytes long
     Returns the result of read_bytes
 */
-int fat16_read_cluster(int cluster, char *buffer)
+int fat16_read_cluster(FAT16FileSystem *fs, int cluster, char *buffer)
+{
+    int offset = fat16_cluster_to_offset(fs, cluster);
+    return fs->disk.read_bytes(fs->dataOffset + offset, fs->clusterSize, buffer);
+}
+
+int fat16_get_next_cluster(FAT16FileSystem *fs, int cluster) {
+    return fs->fat[cluster];
+}
+
+/*
+    Returns how many clusters, starting from 'cluster', are both consecutive 
+    on disk and linked one after the other in the FAT. This is at least 1 
+    for a cluster that is part of a chain
+*/
+int fat16_get_run(FAT16FileSystem *fs, int cluster) {
+    return fs->runs[cluster];
+}
+
+/*
+    Returns true if 'cluster' points to an actual cluster in the data region, 
+    false if it is free, bad or marks the end of a chain
+*/
+static bool fat16_is_cluster_valid(FAT16FileSystem *fs, int cluster)
+{
+    return cluster >= 2 && cluster < fs->clusters + 2;
+}
+
+/*
+    Computes the run of 'cluster' from the FAT entry and the run of the 
+    cluster after it
+*/
+static int fat16_compute_run(FAT16FileSystem *fs, int cluster)
+{
+    int next = fs->fat[cluster];
+    if (next == FAT16_CLUSTER_FREE)
+        return 0;
+    if (next == cluster + 1 && fat16_is_cluster_valid(fs, next))
+        return MIN(fs->runs[next] + 1, FAT16_MAX_RUN);
+    return 1;
+}
+
+/*
+    Recomputes the run of 'cluster' after its FAT entry changed. The runs of 
+    the clusters before it that link to it are updated too, stopping as soon 
+    as one of them doesn't change
+*/
+static void fat16_update_runs(FAT16FileSystem *fs, int cluster)
+{
+    fs->runs[cluster] = fat16_compute_run(fs, cluster);
+    for (int c = cluster - 1; fat16_is_cluster_valid(fs, c) && fs->fat[c] == c + 1; c--) {
+        int run = fat16_compute_run(fs, c);
+        if (run == fs->runs[c])
+            break;
+        fs->runs[c] = run;
+    }
+}
+
+/*
+    Changes the FAT entry of 'cluster' to 'value', keeping the free cluster 
+    bitmap and the runs up to date. The change is only in memory until 
+    fat16_flush
+*/
+static void fat16_set_next_cluster(FAT16FileSystem *fs, int cluster, int value)
+{
+    const int index = cluster - 2;
+    const uint32_t bit = 1u << (index % 32);
+    const int sector = cluster * sizeof(uint16_t) / fs->bootRecord.bytesPerSector;
+    bool was_free = fs->fat[cluster] == FAT16_CLUSTER_FREE;
+
+    fs->fat[cluster] = value;
+    fs->fatDirty = true;
+    fs->dirtyFatSectors[sector / 32] |= 1u << (sector % 32);
+    fat16_update_runs(fs, cluster);
+    if (was_free && value != FAT16_CLUSTER_FREE) {
+        fs->usedClusters[index / 32] |= bit;
+        fs->freeClusters--;
+    } else if (!was_free && value == FAT16_CLUSTER_FREE) {
+        fs->usedClusters[index / 32] &= ~bit;
+        fs->freeClusters++;
+        if (index < fs->nextFree)
+            fs->nextFree = index;
+    }
+}
+
+/*
+    Allocates a free cluster and marks it as the end of a chain. If 'prev' is 
+    a valid cluster the new one is linked after it.
+    The search starts from where the last one stopped and skips 32 used 
+    clusters at a time, so allocating a chain doesn't scan the FAT again 
+    for each cluster.
+    Returns the allocated cluster, -1 if the disk is full
+*/
+static int fat16_alloc_cluster(FAT16FileSystem *fs, int prev)
+{
+    if (fs->freeClusters == 0)
+        return -1;
+
+    const int words = (fs->clusters + 31) / 32;
+    int word = fs->nextFree / 32;
+    for (int i = 0; i <= words; i++) {
+        uint32_t used = fs->usedClusters[word];
+        if (used != 0xffffffff) {
+            int index = word * 32 + __builtin_ctz(~used);
+            int cluster = index + 2;
+            fs->nextFree = index + 1 < fs->clusters ? index + 1 : 0;
+            fat16_set_next_cluster(fs, cluster, FAT16_CLUSTER_EOC);
+            if (fat16_is_cluster_valid(fs, prev))
+                fat16_set_next_cluster(fs, prev, cluster);
+
+            return cluster;
+        }
+        word = (word + 1) % words;
+    }
+
+    return -1;
+}
+
+/*
+    Marks as free all the clusters in the chain starting from 'cluster'
+*/
+static void fat16_free_chain(FAT16FileSystem *fs, int cluster)
+{
+    while (fat16_is_cluster_valid(fs, cluster)) {
+        int next = fat16_get_next_cluster(fs, cluster);
+        fat16_set_next_cluster(fs, cluster, FAT16_CLUSTER_FREE);
+        cluster = next;
+    }
+}
+
+static bool fat16_is_sector_dirty(FAT16FileSystem *fs, int sector)
+{
+    return fs->dirtyFatSectors[sector / 32] & (1u << (sector % 32));
+}
+
+/*
+    Writes the changed sectors of the in-memory FAT to disk, updating every 
+    copy of the table. Consecutive changed sectors are written together. 
+    Changes to the FAT are batched in memory and only written here, this is 
+    called when a file that was written is closed or when a file is deleted.
+    Returns 0 on success, -1 if a write to the disk failed
+*/
+int fat16_flush(FAT16FileSystem *fs)
 {
-    int offset = fat16_cluster_to_offset(cluster);
-    return disk->read_bytes(fs.dataOffset + offset, CLUSTER_SIZE, buffer);
+    if (!fs->fatDirty)
+        return 0;
+
+    const int sector_size = fs->bootRecord.bytesPerSector;
+    const int sectors = fs->bootRecord.sectorsPerFat;
+    const int fat_size = sectors * sector_size;
+    int sector = 0;
+    while (sector < sectors) {
+        if (!fat16_is_sector_dirty(fs, sector)) {
+            sector++;
+            continue;
+        }
+        int last = sector;
+        while (last + 1 < sectors && fat16_is_sector_dirty(fs, last + 1))
+            last++;
+
+        int length = (last - sector + 1) * sector_size;
+        char *data = (char *) fs->fat + sector * sector_size;
+        for (int i = 0; i < fs->bootRecord.fats; i++) {
+            int offset = fs->tableOffset + i * fat_size + sector * sector_size;
+            if (fs->disk.write_bytes(offset, length, data) != 0)
+                return -1;
+        }
+        sector = last + 1;
+    }
+    memset(fs->dirtyFatSectors, 0, (sectors + 31) / 32 * sizeof(uint32_t));
+    fs->fatDirty = false;
+
+    return 0;
 }
 
-int fat16_get_next_cluster(int cluster) {
-    return fs.fat[cluster];
+/*
+    Returns the disk offset of the directory entry after the one at 'offset', 
+    following the cluster chain of the directory when the end of a cluster 
+    is reached.
+    Returns -1 if there are no more entries in the directory
+*/
+static int fat16_next_entry_offset(FAT16FileSystem *fs, int offset)
+{
+    offset += sizeof(FAT16DirEntry);
+    // The root directory is a contiguous area before the data region
+    if (offset <= fs->dataOffset)
+        return offset < fs->dataOffset ? offset : -1;
+
+    const int data_offset = offset - fs->dataOffset;
+    if (data_offset % fs->clusterSize != 0)
+        return offset;
+
+    int next = fat16_get_next_cluster(fs, data_offset / fs->clusterSize + 1);
+    if (!fat16_is_cluster_valid(fs, next))
+        return -1;
+
+    return fs->dataOffset + fat16_cluster_to_offset(fs, next);
 }
 
 int fat16_strcmp(unsigned char *a, unsigned char *b) {
@@ -89,95 +272,175 @@ int fat16_strcmp(unsigned char *a, unsigned char *b) {
     Initializes a FAT16FileSystem struct from a disk.
     Returns 0 on success, -1 if the disk is not a valid FAT16 disk.
 */
-int fat16_read_filesystem(struct DiskInterface *diskinterface)
+int fat16_read_filesystem(FAT16FileSystem *fs, struct DiskInterface *diskinterface)
 {
     size_t br_size = sizeof(struct FAT16BootRecord);
     size_t ebr_size = sizeof(struct FAT16ExtendedBootRecord);
-    disk = diskinterface;
-    disk->read_bytes(0, br_size, (char *) &fs.bootRecord);
-    disk->read_bytes(br_size, ebr_size, (char *) &fs.eBootRecord);
+    fs->disk = *diskinterface;
+    fs->disk.read_bytes(0, br_size, (char *) &fs->bootRecord);
+    fs->disk.read_bytes(br_size, ebr_size, (char *) &fs->eBootRecord);
     
-    int signature = fs.eBootRecord.signature;
+    int signature = fs->eBootRecord.signature;
     if (signature != 0x29 && signature != 0x28) {
         return -1;
     }
 
     // Checks for the file system
-    int bytesPerSector = fs.bootRecord.bytesPerSector;
+    int bytesPerSector = fs->bootRecord.bytesPerSector;
     if (bytesPerSector != 512 && bytesPerSector != 1024 && bytesPerSector != 2048 && bytesPerSector != 4096) {
         return -1;
     }
     // TODO: Implement the other checks
     // see: http://read.pudn.com/downloads77/ebook/294884/FAT32%20Spec%20%28SDA%20Contribution%29.pdf
 
-    int sector_size = fs.bootRecord.bytesPerSector;
-    struct FAT16BootRecord *br = &fs.bootRecord;
-    fs.tableOffset = br->reservedSectors * sector_size;
-    fs.rootDirOffset = fs.tableOffset;
-    fs.rootDirOffset += (sector_size * br->sectorsPerFat * br->fats);
-    fs.dataOffset = fs.rootDirOffset + fs.bootRecord.maxRootEntries * sizeof(FAT16DirEntry);
+    int sector_size = fs->bootRecord.bytesPerSector;
+    struct FAT16BootRecord *br = &fs->bootRecord;
+    fs->tableOffset = br->reservedSectors * sector_size;
+    fs->rootDirOffset = fs->tableOffset;
+    fs->rootDirOffset += (sector_size * br->sectorsPerFat * br->fats);
+    fs->dataOffset = fs->rootDirOffset + fs->bootRecord.maxRootEntries * sizeof(FAT16DirEntry);
+
+    fs->clusterSize = fs->bootRecord.sectorsPerCluster * fs->bootRecord.bytesPerSector;
+
+    int total_sectors = br->volumeSectors != 0 ? br->volumeSectors : (int) br->largeSectorCount;
+    int fat_size = br->sectorsPerFat * sector_size;
+    int data_sectors = total_sectors - fs->dataOffset / sector_size;
+    fs->clusters = MIN(data_sectors / br->sectorsPerCluster, fat_size / 2 - 2);
 
-    CLUSTER_SIZE = fs.bootRecord.sectorsPerCluster * fs.bootRecord.bytesPerSector;
+    fs->fat = (uint16_t *) kmalloc(fat_size);
+    if (fs->fat == NULL)
+        return -1;
+    if (fs->disk.read_bytes(fs->tableOffset, fat_size, (char *) fs->fat) != 0) {
+        kfree(fs->fat);
+        return -1;
+    }
+    fs->fatDirty = false;
+
+    const int words = (fs->clusters + 31) / 32;
+    fs->usedClusters = (uint32_t *) kmalloc(words * sizeof(uint32_t));
+    if (fs->usedClusters == NULL) {
+        kfree(fs->fat);
+        return -1;
+    }
+    // The bits after the last cluster are set so that they are never allocated
+    memset(fs->usedClusters, 0xff, words * sizeof(uint32_t));
+    fs->freeClusters = 0;
+    fs->nextFree = 0;
+    for (int i = 0; i < fs->clusters; i++) {
+        if (fs->fat[i + 2] == FAT16_CLUSTER_FREE) {
+            fs->usedClusters[i / 32] &= ~(1u << (i % 32));
+            fs->freeClusters++;
+        }
+    }
+
+    const int dirty_words = (br->sectorsPerFat + 31) / 32;
+    fs->dirtyFatSectors = (uint32_t *) kmalloc(dirty_words * sizeof(uint32_t));
+    fs->runs = (uint8_t *) kmalloc(fs->clusters + 2);
+    if (fs->dirtyFatSectors == NULL || fs->runs == NULL) {
+        kfree(fs->fat);
+        kfree(fs->usedClusters);
+        if (fs->dirtyFatSectors != NULL)
+            kfree(fs->dirtyFatSectors);
+        if (fs->runs != NULL)
+            kfree(fs->runs);
+        return -1;
+    }
+    memset(fs->dirtyFatSectors, 0, dirty_words * sizeof(uint32_t));
+    // Runs are computed backwards because each one depends on the next
+    fs->runs[0] = fs->runs[1] = 0;
+    for (int c = fs->clusters + 1; c >= 2; c--)
+        fs->runs[c] = fat16_compute_run(fs, c);
+
+    fs->dcache = (struct FAT16Dentry *) kmalloc(FAT16_DCACHE_SLOTS * sizeof(struct FAT16Dentry));
+    if (fs->dcache == NULL) {
+        kfree(fs->fat);
+        kfree(fs->usedClusters);
+        kfree(fs->dirtyFatSectors);
+        kfree(fs->runs);
+        return -1;
+    }
+    memset(fs->dcache, 0, FAT16_DCACHE_SLOTS * sizeof(struct FAT16Dentry));
 
     return 0;
 }
 
 /*
-    Returns the next entry in a directory, given an offset in the disk.
-    @param offset: The offset in the disk, in bytes, where a list of folder 
-    entries starts. This will be changed to point to the next entry in the 
-    folder
-    @param out: A File struct where the read entry will be put
-    @param filename: A string where the filename will be written. This is 
-    expected to be at least 255 characters long and it will be zero terminated
-
-    Returns 1 when there might be more entries in the folder, 0 when there are 
-    no more. The out param will contain a new entry when the function returns 1
+    Copies the part of a long file name stored in 'lfn' in its place in 
+    'filename', which has space for FAT_MAX_FILENAME_LENGTH characters and 
+    the terminator. Entries with an order that can't be right are ignored, 
+    so a corrupted directory never writes outside of 'filename'
+*/
+static void fat16_read_lfn(FAT16LongFileName *lfn, char *filename)
+{
+    const int order = FAT_LFN_GET_ORDER(lfn->order);
+    if (order == 0 || order > FAT_LFN_MAX_ENTRIES)
+        return;
 
-    An example for reading an entire folder can be
+    /*
+        In a long file name entry the actual name is split in 3 parts 
+        in the structure. Each part is made of 2 bytes character but 
+        only the first character is used. The string is 0 terminated 
+        and the rest is filled with 0xff
+    */
+    char chars[FAT_LFN_CHARS];
+    int count = 0;
+    for (int i = 0; i < 10; i += 2) {
+        chars[count++] = lfn->filename1[i];
+    }
+    for (int i = 0; i < 12; i += 2) {
+        chars[count++] = lfn->filename2[i];
+    }
+    for (int i = 0; i < 4; i += 2) {
+        chars[count++] = lfn->filename3[i];
+    }
 
-    File file;
-    char filename[255];
-    int off = ROOT_DIR_OFFSET;
-    while (fat16_ls(&off, &file, filename)) {
-        // Do something with file
+    /*
+        The last entry of the longest names ends past 'filename' with the 
+        terminator and the padding, which are not needed there
+    */
+    int filename_offset = FAT_LFN_CHARS * (order - 1);
+    for (int i = 0; i < count && filename_offset < FAT_MAX_FILENAME_LENGTH; i++) {
+        filename[filename_offset++] = chars[i];
     }
+    /*
+        A name that fills the last entry completely has no space 
+        for the terminator
+    */
+    if (lfn->order & FAT_LFN_LAST_ENTRY) {
+        filename[filename_offset] = '\0';
+    }
+}
+
+/*
+    See 'fat16_ls', this also returns the disk offset of the entry that was 
+    read in 'entryoff' if it is not NULL
 */
-int fat16_ls(int *offset, FAT16DirEntry *out, char *filename)
+static int fat16_ls_support(FAT16FileSystem *fs, int *offset, FAT16DirEntry *out, char *filename, int *entryoff)
 {
     FAT16DirEntry entry = (FAT16DirEntry) {0};
 
-    kassert(0 == disk->read_bytes(*offset, sizeof(FAT16DirEntry), (char *) &entry));
+    if (*offset < 0)
+        return 0;
+    kassert(0 == fs->disk.read_bytes(*offset, sizeof(FAT16DirEntry), (char *) &entry));
     bool used_lfn = false;
     while ( (fat16_is_entry_unused(&entry) && !fat16_is_entry_end(&entry)) || fat16_is_entry_lfn(&entry)) {
-        if (filename != NULL && fat16_is_entry_lfn(&entry)) {
+        // Deleted long file name entries keep their attributes, skip them
+        if (filename != NULL && fat16_is_entry_lfn(&entry) && !fat16_is_entry_unused(&entry)) {
             used_lfn = true;
-            /*
-                In a long file name entry the actual name is split in 3 parts 
-                in the structure. Each part is made of 2 bytes character but 
-                only the first character is used. The string is 0 terminated 
-                and the rest is filled with 0xff
-            */
-            FAT16LongFileName *lfn = (FAT16LongFileName *) &entry;
-            int filename_offset = (10 + 12 + 4)/2 * (FAT_LFN_GET_ORDER(lfn->order)-1);
-            for (int i = 0; i < 10; i += 2) {
-                filename[filename_offset++] = lfn->filename1[i];
-            }
-            for (int i = 0; i < 12; i += 2) {
-                filename[filename_offset++] = lfn->filename2[i];
-            }
-            for (int i = 0; i < 4; i += 2) {
-                filename[filename_offset++] = lfn->filename3[i];
-            }
+            fat16_read_lfn((FAT16LongFileName *) &entry, filename);
         }
-        *offset += sizeof(FAT16DirEntry);
-        kassert(0 == disk->read_bytes(*offset, sizeof(FAT16DirEntry), (char *) &entry));
+        *offset = fat16_next_entry_offset(fs, *offset);
+        if (*offset < 0)
+            return 0;
+        kassert(0 == fs->disk.read_bytes(*offset, sizeof(FAT16DirEntry), (char *) &entry));
     }
 
     if (fat16_is_entry_end(&entry)) {
         return 0;
     } else {
-        *offset += sizeof(FAT16DirEntry);
+        if (entryoff != NULL)
+            *entryoff = *offset;
+        *offset = fat16_next_entry_offset(fs, *offset);
         *out = entry;
         if (!used_lfn) {
             fat16_get_formatted_filename(entry.filename, filename);
@@ -187,37 +450,161 @@ int fat16_ls(int *offset, FAT16DirEntry *out, char *filename)
     }
 }
 
+/*
+    Returns the next entry in a directory, given an offset in the disk.
+    @param offset: The offset in the disk, in bytes, where a list of folder 
+    entries starts. This will be changed to point to the next entry in the 
+    folder
+    @param out: A File struct where the read entry will be put
+    @param filename: A string where the filename will be written. This is 
+    expected to be at least 255 characters long and it will be zero terminated
+
+    Returns 1 when there might be more entries in the folder, 0 when there are 
+    no more. The out param will contain a new entry when the function returns 1
+
+    An example for reading an entire folder can be
+
+    File file;
+    char filename[FAT_MAX_FILENAME_LENGTH + 1];
+    int off = ROOT_DIR_OFFSET;
+    while (fat16_ls(fs, &off, &file, filename)) {
+        // Do something with file
+    }
+*/
+int fat16_ls(FAT16FileSystem *fs, int *offset, FAT16DirEntry *out, char *filename)
+{
+    return fat16_ls_support(fs, offset, out, filename, NULL);
+}
+
+
 /*
     Finds the entry with the given name and returns it in the 'out' argument. 
     @param name: The name of the entry to search for. Note that the name of 
     the entries are not case-sensitive ("Hello", "HELLO", "hElLo" are the same)
     @param diroffset: The offset in the disk of the directory in which to find 
     the entry
-    @param out: Where, if an entry is found, the entry will be stored
+    @param first: If not NULL, this is set to the offset from which the 
+    entries making up the found one start (its long file name entries)
     Returns the disk offset of the entry if found (>0), -1 otherwise
 */
-int fat16_findentry(unsigned char *name, int diroffset) {
+int fat16_findentry(FAT16FileSystem *fs, unsigned char *name, int diroffset, int *first) {
     FAT16DirEntry entry;
     char filename[FAT_MAX_FILENAME_LENGTH + 1];
-    while(fat16_ls(&diroffset, &entry, filename)) {
+    int start = diroffset;
+    int entry_off;
+    while(fat16_ls_support(fs, &diroffset, &entry, filename, &entry_off)) {
         if (fat16_strcmp(filename, name) == 0) {
-            return diroffset - sizeof(FAT16DirEntry);
+            if (first != NULL) { *first = start; }
+            return entry_off;
         }
+        start = diroffset;
     }
 
     return -1;
 }
 
+/*
+    Computes the dentry cache slot of the name 'name' in the directory at 
+    'diroffset', writing the uppercase name in 'key'.
+    Returns the slot, -1 if the name is too long to be cached
+*/
+static int fat16_dcache_slot(const unsigned char *name, int diroffset, unsigned char *key)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ (uint32_t) diroffset;
+    int i;
+    for (i = 0; name[i] != '\0'; i++) {
+        if (i == FAT16_DCACHE_NAME_LEN)
+            return -1;
+        key[i] = toupper(name[i]);
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+    key[i] = '\0';
+
+    return hash % FAT16_DCACHE_SLOTS;
+}
+
+/*
+    Drops every cached entry that refers to the entry at 'entry_off'
+*/
+static void fat16_dcache_forget(FAT16FileSystem *fs, int entry_off)
+{
+    for (int i = 0; i < FAT16_DCACHE_SLOTS; i++) {
+        if (fs->dcache[i].dirOffset != 0 && fs->dcache[i].entryOffset == entry_off)
+            fs->dcache[i].dirOffset = 0;
+    }
+}
+
+/*
+    Updates the cached copy of the entry at 'entry_off' after it was 
+    written to disk
+*/
+static void fat16_dcache_update(FAT16FileSystem *fs, int entry_off, FAT16DirEntry *entry)
+{
+    for (int i = 0; i < FAT16_DCACHE_SLOTS; i++) {
+        if (fs->dcache[i].dirOffset != 0 && fs->dcache[i].entryOffset == entry_off)
+            fs->dcache[i].entry = *entry;
+    }
+}
+
+/*
+    Stores in the dentry cache that 'name' in the directory at 'diroffset' 
+    is the entry at 'entry_off' (-1 if it doesn't exist), replacing whatever 
+    was in its slot
+*/
+static void fat16_dcache_put(FAT16FileSystem *fs, const unsigned char *name, int diroffset, int entry_off, FAT16DirEntry *entry)
+{
+    unsigned char key[FAT16_DCACHE_NAME_LEN + 1];
+    int slot = fat16_dcache_slot(name, diroffset, key);
+    if (slot < 0)
+        return;
+    
+    struct FAT16Dentry *d = &fs->dcache[slot];
+    d->dirOffset = diroffset;
+    d->entryOffset = entry_off;
+    if (entry != NULL)
+        d->entry = *entry;
+    strcpy((char *) d->name, (char *) key);
+}
+
+/*
+    Like fat16_findentry, but it also reads the entry in 'entry'. The result, 
+    even a missing entry, is kept in the dentry cache so that looking up the 
+    same name again doesn't need to scan the directory.
+    Returns the disk offset of the entry, -1 if it doesn't exist
+*/
+static int fat16_lookup(FAT16FileSystem *fs, unsigned char *name, int diroffset, FAT16DirEntry *entry)
+{
+    unsigned char key[FAT16_DCACHE_NAME_LEN + 1];
+    int slot = fat16_dcache_slot(name, diroffset, key);
+    if (slot >= 0) {
+        struct FAT16Dentry *d = &fs->dcache[slot];
+        if (d->dirOffset == diroffset && !strcmp((char *) d->name, (char *) key)) {
+            *entry = d->entry;
+            return d->entryOffset;
+        }
+    }
+
+    int entry_off = fat16_findentry(fs, name, diroffset, NULL);
+    if (entry_off >= 0)
+        kassert(0 == fs->disk.read_bytes(entry_off, sizeof(FAT16DirEntry), (char *) entry));
+    fat16_dcache_put(fs, name, diroffset, entry_off, entry);
+
+    return entry_off;
+}
+
 /*
     See `fat16_open`, this is the implementation of that function.
     @param path: Absolute path, starting with '/', to the entry
     @param length: Length of the path string
+    @param entryoff: If not NULL, this is set to the disk offset of the entry 
+    in its parent directory. This is not set for the root
     @returns disk offset on success, -1 if it wasnt able to follow the 
     path(missing directory, for example)
 */
-int fat16_open_support(const char *path, int length, FAT16DirEntry *entry) {
+int fat16_open_support(FAT16FileSystem *fs, const char *path, int length, FAT16DirEntry *entry, int *entryoff) {
     if (length <= 1){
-        return fs.rootDirOffset;
+        return fs->rootDirOffset;
     }
 
     int last_slash = length - 1;
@@ -225,25 +612,31 @@ int fat16_open_support(const char *path, int length, FAT16DirEntry *entry) {
         last_slash--;
     }
 
-    int diroff = fat16_open_support(path, last_slash, entry);
+    int diroff = fat16_open_support(fs, path, last_slash, entry, NULL);
     // Directory was not found
     if (diroff < 0)     return -1;
 
     // Extracts the path of the parent folder
-    unsigned char dirname[FAT_MAX_FILENAME_LENGTH];
+    unsigned char dirname[FAT_MAX_FILENAME_LENGTH + 1];
     int dirname_length = length - (last_slash+1);
+    if (dirname_length > FAT_MAX_FILENAME_LENGTH)
+        return -1;
     memcpy(dirname, &path[last_slash+1], dirname_length);
     dirname[dirname_length] = '\0';
 
-    int entry_off = fat16_findentry(dirname, diroff);
+    FAT16DirEntry e;
+    int entry_off = fat16_lookup(fs, dirname, diroff, &e);
     if (entry_off < 0) {
         return -1;
     }
-    FAT16DirEntry e;
-    kassert(0 == disk->read_bytes(entry_off, sizeof(FAT16DirEntry), (char *) &e));
     if (entry != NULL) { *entry = e; }
+    if (entryoff != NULL) { *entryoff = entry_off; }
 
-    return fs.dataOffset + fat16_cluster_to_offset(e.lowStartingClusterNumber);
+    // The '..' entry of a directory inside the root points to cluster 0
+    if (e.lowStartingClusterNumber == 0 && e.attributes & FAT_ATTR_DIRECTORY)
+        return fs->rootDirOffset;
+
+    return fs->dataOffset + fat16_cluster_to_offset(fs, e.lowStartingClusterNumber);
 }
 
 /*
@@ -265,56 +658,767 @@ int fat16_open_support(const char *path, int length, FAT16DirEntry *entry) {
     Returns the offset of the content of entry in the disk or -1 if the path couldn't be 
     followed.
 */
-int fat16_open(const char *path, FAT16DirEntry *entry) {
-    return fat16_open_support(path, strlen(path), entry);
+int fat16_open(FAT16FileSystem *fs, const char *path, FAT16DirEntry *entry) {
+    return fat16_open_support(fs, path, strlen(path), entry, NULL);
+}
+
+/*
+    Finds the directory that contains the last component of 'path'. 'name' 
+    is set to point to that last component inside 'path'.
+    Returns the disk offset of the content of the directory, -1 if it 
+    doesn't exist or it is not a directory
+*/
+static int fat16_open_parent(FAT16FileSystem *fs, const char *path, const char **name)
+{
+    if (path[0] != '/')
+        return -1;
+
+    int last_slash = strlen(path) - 1;
+    while (last_slash > 0 && path[last_slash] != '/') {
+        last_slash--;
+    }
+
+    FAT16DirEntry parent;
+    int parent_off = -1;
+    int diroff = fat16_open_support(fs, path, last_slash, &parent, &parent_off);
+    if (diroff < 0)
+        return -1;
+    if (parent_off >= 0 && !(parent.attributes & FAT_ATTR_DIRECTORY))
+        return -1;
+    
+    *name = &path[last_slash + 1];
+    return diroff;
+}
+
+/*
+    Sets the last modification time of an entry to now. If 'creation' is 
+    true the creation time is set too
+*/
+static void fat16_set_times(FAT16DirEntry *entry, bool creation)
+{
+    struct DateTime now;
+    if (get_datetime(&now) != 0)
+        return;
+
+    uint16_t time = FAT16_MAKE_TIME(now.hours, now.minutes, now.seconds);
+    uint16_t date = FAT16_MAKE_DATE(now.year, now.month, now.day);
+    entry->lastModTime = time;
+    entry->lastModDate = date;
+    entry->lastAccessDate = date;
+    if (creation) {
+        entry->creationTime = time;
+        entry->creationDate = date;
+    }
+}
+
+/*
+    Returns true if the character can be used in a 8.3 name as it is
+*/
+static bool fat16_is_shortname_char(char c)
+{
+    if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+        return true;
+    
+    const char *special = "!#$%&'()-@^_`{}~";
+    for (int i = 0; special[i]; i++) {
+        if (special[i] == c)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+    Checks if 'name' can be stored as it is in a 8.3 entry, without losing 
+    anything (case included). If it can, the 11 bytes version is written 
+    in 'shortname'.
+    Returns true if the name fits, false if it needs long file name entries
+*/
+static bool fat16_fits_shortname(const char *name, unsigned char *shortname)
+{
+    memset(shortname, ' ', FAT_FILENAME_LENGTH);
+    int i = 0, j = 0;
+    for (; name[i] && name[i] != '.'; i++) {
+        if (j == 8 || !fat16_is_shortname_char(name[i]))
+            return false;
+        shortname[j++] = name[i];
+    }
+    if (j == 0)
+        return false;
+
+    if (name[i] == '.') {
+        i++;
+        for (j = 8; name[i]; i++) {
+            if (j == FAT_FILENAME_LENGTH || !fat16_is_shortname_char(name[i]))
+                return false;
+            shortname[j++] = name[i];
+        }
+        // Names ending with a dot are not valid
+        if (j == 8)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+    Generates the 8.3 alias for a long file name, in the form 'BASE~N.EXT'. 
+    'n' is the number after the tilde, the caller needs to change it until 
+    the alias is unique in its directory
+*/
+static void fat16_make_shortname(const char *name, int n, unsigned char *shortname)
+{
+    memset(shortname, ' ', FAT_FILENAME_LENGTH);
+
+    const char *dot = NULL;
+    for (const char *c = name + 1; *c; c++) {
+        if (*c == '.')
+            dot = c;
+    }
+
+    int base_length = 0;
+    for (const char *c = name; *c && c != dot && base_length < 8; c++) {
+        if (*c == ' ' || *c == '.')
+            continue;
+        char upper = toupper(*c);
+        shortname[base_length++] = fat16_is_shortname_char(upper) ? upper : '_';
+    }
+    if (dot != NULL) {
+        int j = 8;
+        for (const char *c = dot + 1; *c && j < FAT_FILENAME_LENGTH; c++) {
+            if (*c == ' ' || *c == '.')
+                continue;
+            char upper = toupper(*c);
+            shortname[j++] = fat16_is_shortname_char(upper) ? upper : '_';
+        }
+    }
+
+    char digits[8];
+    int ndigits = 0;
+    do {
+        digits[ndigits++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+
+    int pos = MIN(base_length, 8 - (ndigits + 1));
+    shortname[pos++] = '~';
+    while (ndigits > 0) {
+        shortname[pos++] = digits[--ndigits];
+    }
+    while (pos < 8) {
+        shortname[pos++] = ' ';
+    }
+}
+
+/*
+    Returns true if an entry with the given 11 bytes name exists in the 
+    directory starting at 'diroffset'
+*/
+static bool fat16_shortname_exists(FAT16FileSystem *fs, int diroffset, unsigned char *shortname)
+{
+    FAT16DirEntry entry;
+    for (int off = diroffset; off >= 0; off = fat16_next_entry_offset(fs, off)) {
+        kassert(0 == fs->disk.read_bytes(off, sizeof(FAT16DirEntry), (char *) &entry));
+        if (fat16_is_entry_end(&entry))
+            break;
+        if (fat16_is_entry_unused(&entry) || fat16_is_entry_lfn(&entry))
+            continue;
+        if (memcmp(entry.filename, shortname, FAT_FILENAME_LENGTH) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static uint8_t fat16_lfn_checksum(unsigned char *shortname)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < FAT_FILENAME_LENGTH; i++) {
+        sum = ((sum & 1) << 7) + (sum >> 1) + shortname[i];
+    }
+
+    return sum;
+}
+
+/*
+    Writes zeros over a whole cluster
+    Returns 0 on success, -1 otherwise
+*/
+static int fat16_clear_cluster(FAT16FileSystem *fs, int cluster)
+{
+    char *zero = kmalloc(fs->clusterSize);
+    if (zero == NULL)
+        return -1;
+    memset(zero, 0, fs->clusterSize);
+    int offset = fs->dataOffset + fat16_cluster_to_offset(fs, cluster);
+    int result = fs->disk.write_bytes(offset, fs->clusterSize, zero);
+    kfree(zero);
+
+    return result;
+}
+
+/*
+    Finds 'count' consecutive free entries in a directory, writing their disk 
+    offsets in 'slots'. If there is not enough space the directory is grown 
+    by one or more clusters. The root directory cannot grow.
+    Returns 0 on success, -1 if there is no space left
+*/
+static int fat16_find_free_entries(FAT16FileSystem *fs, int diroffset, int count, int *slots)
+{
+    int found = 0;
+    int last = diroffset;
+    for (int off = diroffset; off >= 0; off = fat16_next_entry_offset(fs, off)) {
+        unsigned char first;
+        kassert(0 == fs->disk.read_bytes(off, 1, (char *) &first));
+        if (first == FAT_ENTRY_END || first == FAT_ENTRY_UNUSED) {
+            slots[found++] = off;
+            if (found == count)
+                return 0;
+        } else {
+            found = 0;
+        }
+        last = off;
+    }
+
+    if (last < fs->dataOffset)
+        return -1;
+    
+    int cluster = (last - fs->dataOffset) / fs->clusterSize + 2;
+    while (found < count) {
+        cluster = fat16_alloc_cluster(fs, cluster);
+        if (cluster < 0 || fat16_clear_cluster(fs, cluster) != 0)
+            return -1;
+        int offset = fs->dataOffset + fat16_cluster_to_offset(fs, cluster);
+        for (int i = 0; i < fs->clusterSize && found < count; i += sizeof(FAT16DirEntry)) {
+            slots[found++] = offset + i;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Fills a long file name entry with the part of 'name' it stores. 'order' 
+    goes from 1, the entry with the start of the name, to 'entries'
+*/
+static void fat16_fill_lfn(
+    FAT16LongFileName *lfn, 
+    const char *name, int length, 
+    int order, int entries, 
+    uint8_t checksum
+)
+{
+    unsigned char chars[FAT_LFN_CHARS * 2];
+    for (int i = 0; i < FAT_LFN_CHARS; i++) {
+        int index = (order - 1) * FAT_LFN_CHARS + i;
+        if (index < length) {
+            chars[2*i] = name[index];
+            chars[2*i + 1] = 0;
+        } else if (index == length) {
+            chars[2*i] = chars[2*i + 1] = 0;
+        } else {
+            chars[2*i] = chars[2*i + 1] = 0xff;
+        }
+    }
+
+    *lfn = (FAT16LongFileName) {0};
+    lfn->order = order | (order == entries ? FAT_LFN_LAST_ENTRY : 0);
+    lfn->attribute = FAT_ATTR_LFN;
+    lfn->checksum = checksum;
+    memcpy(lfn->filename1, chars, 10);
+    memcpy(lfn->filename2, chars + 10, 12);
+    memcpy(lfn->filename3, chars + 22, 4);
+}
+
+/*
+    Creates an empty file at the given absolute path. The parent directory 
+    needs to exist already. If the name doesn't fit in a 8.3 entry, long 
+    file name entries are written before it.
+    Returns the disk offset of the new entry and writes it in 'out', -1 on 
+    failure
+*/
+static int fat16_create(FAT16FileSystem *fs, const char *path, FAT16DirEntry *out)
+{
+    const char *name;
+    int diroff = fat16_open_parent(fs, path, &name);
+    if (diroff < 0)
+        return -1;
+
+    const int length = strlen(name);
+    if (length == 0 || length > FAT_MAX_FILENAME_LENGTH)
+        return -1;
+    if (!strcmp(name, ".") || !strcmp(name, ".."))
+        return -1;
+    for (int i = 0; i < length; i++) {
+        const char *invalid = "\\/:*?\"<>|";
+        if (name[i] < ' ' || name[i] == 0x7f)
+            return -1;
+        for (int j = 0; invalid[j]; j++) {
+            if (name[i] == invalid[j])
+                return -1;
+        }
+    }
+
+    FAT16DirEntry entry = (FAT16DirEntry) {0};
+    int lfn_entries = 0;
+    if (!fat16_fits_shortname(name, entry.filename)) {
+        lfn_entries = (length + FAT_LFN_CHARS - 1) / FAT_LFN_CHARS;
+        int n = 1;
+        do {
+            fat16_make_shortname(name, n++, entry.filename);
+        } while (fat16_shortname_exists(fs, diroff, entry.filename));
+    }
+
+    int slots[FAT_MAX_FILENAME_LENGTH / FAT_LFN_CHARS + 2];
+    if (fat16_find_free_entries(fs, diroff, lfn_entries + 1, slots) != 0)
+        return -1;
+    
+    // Long file name entries are stored in reverse order before the 8.3 one
+    uint8_t checksum = fat16_lfn_checksum(entry.filename);
+    for (int i = 0; i < lfn_entries; i++) {
+        FAT16LongFileName lfn;
+        int order = lfn_entries - i;
+        fat16_fill_lfn(&lfn, name, length, order, lfn_entries, checksum);
+        if (fs->disk.write_bytes(slots[i], sizeof(lfn), (char *) &lfn) != 0)
+            return -1;
+    }
+
+    entry.attributes = FAT_ATTR_ARCHIVE;
+    fat16_set_times(&entry, true);
+    int entry_off = slots[lfn_entries];
+    if (fs->disk.write_bytes(entry_off, sizeof(entry), (char *) &entry) != 0)
+        return -1;
+    // This replaces a negative entry for the name, if there is one
+    fat16_dcache_put(fs, (unsigned char *) name, diroff, entry_off, &entry);
+    
+    *out = entry;
+    return entry_off;
+}
+
+/*
+    Follows the chain starting from 'cluster' for 'steps' links, jumping over 
+    whole runs of contiguous clusters instead of reading every FAT entry. 
+    If 'prev' is not NULL it is set to the cluster before the returned one, 
+    it is left unchanged if 'steps' is 0.
+    Returns the cluster reached, which is not valid if the chain ended first
+*/
+static int fat16_walk_chain(FAT16FileSystem *fs, int cluster, int steps, int *prev)
+{
+    while (steps > 0 && fat16_is_cluster_valid(fs, cluster)) {
+        int run = fat16_get_run(fs, cluster);
+        if (run > 1) {
+            int jump = MIN(run - 1, steps);
+            cluster += jump;
+            steps -= jump;
+            if (prev != NULL)
+                *prev = cluster - 1;
+        } else {
+            if (prev != NULL)
+                *prev = cluster;
+            cluster = fat16_get_next_cluster(fs, cluster);
+            steps--;
+        }
+    }
+
+    return cluster;
+}
+
+/*
+    Records that 'cluster' is the 'logical'th cluster of the file, if that is 
+    the next slot of the handle cluster index. When the index is full the 
+    stride is doubled, keeping only the slots that are still multiples of it
+*/
+static void fat16_index_add(struct FAT16FileHandle *handle, int logical, int cluster)
+{
+    if (handle->indexed == FAT16_INDEX_SLOTS) {
+        for (int i = 0; i < FAT16_INDEX_SLOTS / 2; i++)
+            handle->clusterIndex[i] = handle->clusterIndex[2 * i];
+        handle->indexed = FAT16_INDEX_SLOTS / 2;
+        handle->indexStride *= 2;
+    }
+    if (logical % handle->indexStride == 0 && logical / handle->indexStride == handle->indexed)
+        handle->clusterIndex[handle->indexed++] = cluster;
+}
+
+/*
+    Returns the cluster number of the 'index'th cluster of the file. The walk 
+    starts from the closest indexed cluster before it and adds to the index 
+    the clusters it passes, so seeking anywhere in a file walks at most 
+    'indexStride' links once the index is built.
+    Returns an invalid cluster if the file has less than 'index'+1 clusters
+*/
+static int fat16_find_cluster(struct FAT16FileHandle *handle, int index)
+{
+    FAT16FileSystem *fs = handle->fs;
+    if (handle->indexed == 0) {
+        if (!fat16_is_cluster_valid(fs, handle->initialCluster))
+            return handle->initialCluster;
+        fat16_index_add(handle, 0, handle->initialCluster);
+    }
+
+    int slot = MIN(index / handle->indexStride, handle->indexed - 1);
+    int cluster = handle->clusterIndex[slot];
+    int logical = slot * handle->indexStride;
+    while (logical < index && fat16_is_cluster_valid(fs, cluster)) {
+        int next_slot = (logical / handle->indexStride + 1) * handle->indexStride;
+        int steps = MIN(index, next_slot) - logical;
+        cluster = fat16_walk_chain(fs, cluster, steps, NULL);
+        logical += steps;
+        if (logical == next_slot && fat16_is_cluster_valid(fs, cluster))
+            fat16_index_add(handle, logical, cluster);
+    }
+
+    return cluster;
+}
+
+/*
+    Updates 'cluster' and 'prevCluster' of a handle to match its position. 
+    When the position is at the end of a cluster, 'cluster' is the one after 
+    it as if the handle got there by reading
+*/
+static void fat16_locate(struct FAT16FileHandle *handle)
+{
+    FAT16FileSystem *fs = handle->fs;
+    int index = handle->position / fs->clusterSize;
+    if (index == 0) {
+        handle->prevCluster = 0;
+        handle->cluster = handle->initialCluster;
+        return;
+    }
+
+    int prev = fat16_find_cluster(handle, index - 1);
+    handle->prevCluster = prev;
+    if (fat16_is_cluster_valid(fs, prev))
+        handle->cluster = fat16_get_next_cluster(fs, prev);
+    else
+        handle->cluster = prev;
 }
 
 /*
     Opens a file given an absolute pathname. 
-    TODO: This only works for reading, implement write & append
+    @param flags: The VFS_MODE_* flags. With VFS_MODE_CREATE the file is 
+    created if it doesn't exist, with VFS_MODE_TRUNCATE its content is 
+    deleted when opened
     Returns 0 on success, -1 if the file could not be opened
 */
-int fat16_fopen(const char *path, char mode, struct FAT16FileHandle *handle) {
-    // TODO: Implement other modes
-    kassert(mode == 'r');
-
+int fat16_fopen(FAT16FileSystem *fs, const char *path, int flags, struct FAT16FileHandle *handle) {
     FAT16DirEntry entry;
-    int file_off = fat16_open(path, &entry);
-    if (file_off <= 0)
+    int entry_off = -1;
+    int file_off = fat16_open_support(fs, path, strlen(path), &entry, &entry_off);
+    if (file_off < 0) {
+        if (!(flags & VFS_MODE_CREATE))
+            return -1;
+        entry_off = fat16_create(fs, path, &entry);
+        if (entry_off < 0)
+            return -1;
+    } else if (entry_off < 0) {
+        // This is the root directory
         return -1;
+    }
 
+    const int readonly = FAT_ATTR_DIRECTORY | FAT_ATTR_READONLY | FAT_ATTR_VOLUMEID;
+    if (flags & VFS_MODE_WRITE && entry.attributes & readonly)
+        return -1;
+
+    handle->fs = fs;
     handle->position = 0;
     handle->cluster = entry.lowStartingClusterNumber;
     handle->initialCluster = entry.lowStartingClusterNumber;
     handle->filesize = entry.filesize;
+    handle->prevCluster = 0;
+    handle->entryOffset = entry_off;
+    handle->flags = flags;
+    handle->dirty = false;
+    handle->clusterCache = NULL;
+    handle->cachedCluster = 0;
+    handle->indexStride = FAT16_INDEX_STRIDE;
+    handle->indexed = 0;
+
+    if (flags & VFS_MODE_TRUNCATE && handle->filesize > 0)
+        fat16_ftruncate(handle, 0);
+
+    return 0;
+}
+
+/*
+    Makes sure the current cluster of the handle is in its cluster cache, 
+    reading it from disk only if the cache holds a different one.
+    Returns 0 on success, -1 if the cache could not be allocated or the 
+    cluster could not be read
+*/
+static int fat16_cache_cluster(struct FAT16FileHandle *handle)
+{
+    FAT16FileSystem *fs = handle->fs;
+    if (handle->cachedCluster == handle->cluster)
+        return 0;
+    
+    if (handle->clusterCache == NULL) {
+        handle->clusterCache = (char *) kmalloc(fs->clusterSize);
+        if (handle->clusterCache == NULL)
+            return -1;
+    }
+    if (fat16_read_cluster(fs, handle->cluster, handle->clusterCache) != 0) {
+        handle->cachedCluster = 0;
+        return -1;
+    }
+    handle->cachedCluster = handle->cluster;
 
     return 0;
 }
 
 /*
     Reads up to 'count' bytes into the array 'buffer' from the file 'handle'. 
-    The file position is advanced up to 'count' bytes forward.
+    The file position is advanced up to 'count' bytes forward. 
+    Whole clusters are read straight into 'buffer', with a single disk access 
+    for each run of contiguous clusters. Parts of a cluster are copied from 
+    the cluster cached in the handle, so small sequential reads only access 
+    the disk once per cluster.
     Returns the number of read bytes, this can be lower than requested.
 */
 int fat16_fread(struct FAT16FileHandle *handle, int count, char *buffer) {
-    int i = 0;
+    FAT16FileSystem *fs = handle->fs;
+    int remaining = handle->filesize - handle->position;
+    if (count > remaining)
+        count = remaining;
+
     int copied = 0;
-    int position = handle->position;
+    while (copied < count && fat16_is_cluster_valid(fs, handle->cluster)) {
+        const int cluster_offset = handle->position % fs->clusterSize;
+        const int left = count - copied;
+        int to_read;
+        if (cluster_offset != 0 || left < fs->clusterSize) {
+            if (fat16_cache_cluster(handle) != 0)
+                break;
+            to_read = MIN(fs->clusterSize - cluster_offset, left);
+            memcpy(buffer + copied, handle->clusterCache + cluster_offset, to_read);
+        } else {
+            int clusters = MIN(fat16_get_run(fs, handle->cluster), left / fs->clusterSize);
+            int offset = fs->dataOffset + fat16_cluster_to_offset(fs, handle->cluster);
+            to_read = clusters * fs->clusterSize;
+            if (fs->disk.read_bytes(offset, to_read, buffer + copied) != 0)
+                break;
+        }
+
+        copied += to_read;
+        handle->position += to_read;
+        int crossed = (cluster_offset + to_read) / fs->clusterSize;
+        handle->cluster = fat16_walk_chain(fs, handle->cluster, crossed, &handle->prevCluster);
+    }
+
+    return copied;
+}
+
+/*
+    Writes the slices one after the other on the disk from 'offset', with a 
+    single call if the disk supports vectored writes.
+    Returns 0 on success, -1 otherwise
+*/
+static int fat16_write_slices(FAT16FileSystem *fs, int offset, struct IOVec *slices, int count)
+{
+    if (fs->disk.write_bytesv != NULL)
+        return fs->disk.write_bytesv(offset, slices, count);
+
+    for (int i = 0; i < count; i++) {
+        if (fs->disk.write_bytes(offset, slices[i].length, slices[i].base) != 0)
+            return -1;
+        offset += slices[i].length;
+    }
+
+    return 0;
+}
+
+/*
+    Writes the segments one after the other in the file at the handle 
+    position, allocating new clusters when the write goes past the end of 
+    the chain. The part of each cluster is sent to the disk as a single 
+    vectored write of the segments it covers, without copying them. 
+    The changes to the FAT and to the file entry are written to disk only 
+    when the file is closed.
+    Returns the number of written bytes, -1 if the file was not opened for 
+    writing
+*/
+int fat16_fwritev(struct FAT16FileHandle *handle, struct IOVec *iov, int iovcount) {
+    FAT16FileSystem *fs = handle->fs;
+    if (!(handle->flags & VFS_MODE_WRITE))
+        return -1;
     
-    int cluster_index = handle->cluster;
-    char cluster[CLUSTER_SIZE];
-    kassert(0 == fat16_read_cluster(handle->cluster, cluster));
-
-    while (copied < count && position < handle->filesize) {
-        buffer[i++] = cluster[position++ % CLUSTER_SIZE];
-        copied++;
-        if (position % CLUSTER_SIZE == 0) {
-            cluster_index = fat16_get_next_cluster(cluster_index);
-            kassert(0 == fat16_read_cluster(cluster_index, cluster));
+    if (handle->flags & VFS_MODE_APPEND && handle->position != handle->filesize) {
+        handle->position = handle->filesize;
+        fat16_locate(handle);
+    }
+
+    struct IOCursor cursor;
+    struct IOVec slices[FAT16_WRITEV_SLICES];
+    iocursor_init(&cursor, iov, iovcount);
+    const int count = iovec_length(iov, iovcount);
+    int written = 0;
+    while (written < count) {
+        if (!fat16_is_cluster_valid(fs, handle->cluster)) {
+            int cluster = fat16_alloc_cluster(fs, handle->prevCluster);
+            if (cluster < 0)
+                break;
+            if (handle->prevCluster == 0)
+                handle->initialCluster = cluster;
+            handle->cluster = cluster;
         }
+
+        const int cluster_offset = handle->position % fs->clusterSize;
+        int to_write;
+        int nslices = iocursor_slice(
+            &cursor, MIN(fs->clusterSize - cluster_offset, count - written), 
+            slices, FAT16_WRITEV_SLICES, &to_write);
+        int offset = fs->dataOffset + fat16_cluster_to_offset(fs, handle->cluster);
+        offset += cluster_offset;
+        if (fat16_write_slices(fs, offset, slices, nslices) != 0)
+            break;
+        if (handle->cluster == handle->cachedCluster) {
+            char *dest = handle->clusterCache + cluster_offset;
+            for (int i = 0; i < nslices; i++) {
+                memcpy(dest, slices[i].base, slices[i].length);
+                dest += slices[i].length;
+            }
+        }
+        
+        written += to_write;
+        handle->position += to_write;
+        handle->dirty = true;
+        if (handle->position > handle->filesize)
+            handle->filesize = handle->position;
+        if (handle->position % fs->clusterSize == 0) {
+            handle->prevCluster = handle->cluster;
+            handle->cluster = fat16_get_next_cluster(fs, handle->cluster);
+        }
+    }
+
+    return written;
+}
+
+/*
+    Writes 'count' bytes from 'buffer' in the file at the handle position, 
+    see fat16_fwritev.
+    Returns the number of written bytes, -1 if the file was not opened for 
+    writing
+*/
+int fat16_fwrite(struct FAT16FileHandle *handle, int count, char *buffer) {
+    struct IOVec segment = { .base = buffer, .length = count };
+
+    return fat16_fwritev(handle, &segment, 1);
+}
+
+/*
+    Shrinks the file to 'size' bytes, freeing the clusters that are not 
+    needed anymore. 
+    Returns 0 on success, -1 if the file is not opened for writing or 'size' 
+    is bigger than the file
+*/
+int fat16_ftruncate(struct FAT16FileHandle *handle, int size) {
+    FAT16FileSystem *fs = handle->fs;
+    if (!(handle->flags & VFS_MODE_WRITE))
+        return -1;
+    if (size < 0 || size > handle->filesize)
+        return -1;
+
+    const int keep = (size + fs->clusterSize - 1) / fs->clusterSize;
+    if (keep == 0) {
+        fat16_free_chain(fs, handle->initialCluster);
+        handle->initialCluster = 0;
+    } else {
+        int last = handle->initialCluster;
+        for (int i = 1; i < keep; i++) {
+            last = fat16_get_next_cluster(fs, last);
+        }
+        fat16_free_chain(fs, fat16_get_next_cluster(fs, last));
+        fat16_set_next_cluster(fs, last, FAT16_CLUSTER_EOC);
     }
+
+    handle->filesize = size;
+    handle->dirty = true;
+    // The cached and indexed clusters could have been freed
+    handle->cachedCluster = 0;
+    handle->indexed = 0;
+    if (handle->position > size)
+        handle->position = size;
+    fat16_locate(handle);
+
+    return 0;
+}
+
+/*
+    Moves the position of the file to 'position', which must be between 0 
+    and the file size (both included).
+    Returns the new position, -1 if 'position' is outside the file
+*/
+int fat16_fseek(struct FAT16FileHandle *handle, int position) {
+    if (position < 0 || position > handle->filesize)
+        return -1;
+    
     handle->position = position;
-    handle->cluster = cluster_index;
+    fat16_locate(handle);
 
-    return copied;
-}
\ No newline at end of file
+    return position;
+}
+
+/*
+    Writes back the changes made to a file: its entry in the parent 
+    directory and the FAT, and releases the cluster cache of the handle. 
+    Returns 0 on success, -1 if a write to the disk failed
+*/
+int fat16_fclose(struct FAT16FileHandle *handle) {
+    FAT16FileSystem *fs = handle->fs;
+    if (handle->clusterCache != NULL) {
+        kfree(handle->clusterCache);
+        handle->clusterCache = NULL;
+        handle->cachedCluster = 0;
+    }
+
+    if (handle->dirty) {
+        FAT16DirEntry entry;
+        if (fs->disk.read_bytes(handle->entryOffset, sizeof(entry), (char *) &entry) != 0)
+            return -1;
+        entry.lowStartingClusterNumber = handle->initialCluster;
+        entry.filesize = handle->filesize;
+        entry.attributes |= FAT_ATTR_ARCHIVE;
+        fat16_set_times(&entry, false);
+        if (fs->disk.write_bytes(handle->entryOffset, sizeof(entry), (char *) &entry) != 0)
+            return -1;
+        fat16_dcache_update(fs, handle->entryOffset, &entry);
+        handle->dirty = false;
+    }
+
+    return fat16_flush(fs);
+}
+
+/*
+    Deletes a file, freeing its clusters and marking its entries as unused. 
+    Returns 0 on success, -1 if the file doesn't exist or it is a directory
+*/
+int fat16_unlink(FAT16FileSystem *fs, const char *path) {
+    const char *name;
+    int diroff = fat16_open_parent(fs, path, &name);
+    if (diroff < 0 || name[0] == '\0')
+        return -1;
+
+    int first;
+    int entry_off = fat16_findentry(fs, (unsigned char *) name, diroff, &first);
+    if (entry_off < 0)
+        return -1;
+    
+    FAT16DirEntry entry;
+    kassert(0 == fs->disk.read_bytes(entry_off, sizeof(entry), (char *) &entry));
+    if (entry.attributes & (FAT_ATTR_DIRECTORY | FAT_ATTR_VOLUMEID))
+        return -1;
+    
+    fat16_free_chain(fs, entry.lowStartingClusterNumber);
+    fat16_dcache_forget(fs, entry_off);
+    
+    // This also marks the long file name entries before the 8.3 one
+    const unsigned char unused = FAT_ENTRY_UNUSED;
+    for (int off = first; off >= 0; off = fat16_next_entry_offset(fs, off)) {
+        if (fs->disk.write_bytes(off, 1, (char *) &unused) != 0)
+            return -1;
+        if (off == entry_off)
+            break;
+    }
+
+    return fat16_flush(fs);
+}
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <kernel/devices/vdisk.h>
+#include <kernel/lib/iovec.h>
 
 
 #define FAT_OEM_LENGTH 8
@@ -22,7 +24,32 @@
 #define FAT_ATTR_ARCHIVE    0x20
 #define FAT_ATTR_LFN        0x0F
 
-#define FAT_LFN_GET_ORDER(x) ((x) & 0x0f)
+#define FAT_LFN_GET_ORDER(x) ((x) & 0x1f)
+#define FAT_LFN_LAST_ENTRY  0x40
+// How many characters of the name are stored in a single LFN entry
+#define FAT_LFN_CHARS       13
+// How many LFN entries the longest name needs
+#define FAT_LFN_MAX_ENTRIES \
+    ((FAT_MAX_FILENAME_LENGTH + FAT_LFN_CHARS - 1) / FAT_LFN_CHARS)
+
+#define FAT_ENTRY_END       0x00
+#define FAT_ENTRY_UNUSED    0xe5
+
+#define FAT16_CLUSTER_FREE  0x0000
+#define FAT16_CLUSTER_EOC   0xffff
+#define FAT16_IS_EOC(x)     ((x) >= 0xfff8)
+
+// The longest contiguous run of clusters tracked in FAT16FileSystem.runs
+#define FAT16_MAX_RUN       255
+
+// Slots in the cluster index of a file handle, and the starting distance
+// (in clusters) between two indexed clusters
+#define FAT16_INDEX_SLOTS   64
+#define FAT16_INDEX_STRIDE  16
+
+// How many pieces of the segments of a vectored write are sent to the disk
+// in a single call, for each cluster
+#define FAT16_WRITEV_SLICES 16
 
 #define FAT16_GET_HOURS(x) ((x) >> 11)
 #define FAT16_GET_MINUTES(x) ((x) >> 5 & 0x7f)
@@ -32,6 +59,9 @@
 #define FAT16_GET_MONTH(x) ((x) >> 5 & 0x0f)
 #define FAT16_GET_DAY(x) ((x) & 0x1f)
 
+#define FAT16_MAKE_TIME(h, m, s) (((h) << 11) | ((m) << 5) | ((s) / 2))
+#define FAT16_MAKE_DATE(y, m, d) ((((y) - 1980) << 9) | ((m) << 5) | (d))
+
 /*
     These are data structures saved on disk
 */
@@ -96,11 +126,32 @@ typedef struct FAT16LongFileName FAT16LongFileName;
 
 typedef uint16_t FATEntry;
 
+// Slots in the directory entry cache and the longest name it can store
+#define FAT16_DCACHE_SLOTS      256
+#define FAT16_DCACHE_NAME_LEN   47
+
+/*
+    A cached lookup of 'name' in the directory whose content starts at the 
+    disk offset 'dirOffset'. An 'entryOffset' of -1 means that the directory 
+    has no entry with that name. Names are stored uppercase because lookups 
+    are not case-sensitive. Unused slots have 'dirOffset' 0
+*/
+struct FAT16Dentry {
+    int dirOffset;
+    int entryOffset;
+    FAT16DirEntry entry;
+    unsigned char name[FAT16_DCACHE_NAME_LEN + 1];
+};
+
 /*
     These are NOT actual structures on disk
 */
 
 struct FAT16FileSystem {
+    // A copy of the interface of the disk the file system is on
+    struct DiskInterface disk;
+    // The size of a cluster in bytes
+    int clusterSize;
     uint16_t *fat;
     char *ramdisk;
     struct FAT16BootRecord bootRecord;
@@ -108,6 +159,30 @@ struct FAT16FileSystem {
     int tableOffset;
     int rootDirOffset;
     int dataOffset;
+    // The number of clusters in the data region
+    int clusters;
+    /*
+        One bit for each data cluster, set if the cluster is in use. Built 
+        from the FAT at mount, it lets us find free clusters without 
+        walking the table entry by entry
+    */
+    uint32_t *usedClusters;
+    int freeClusters;
+    // Where the search for the next free cluster starts from
+    int nextFree;
+    // Set when 'fat' was changed and needs to be written back to disk
+    bool fatDirty;
+    // One bit for each sector of the FAT, set if the sector was changed
+    uint32_t *dirtyFatSectors;
+    /*
+        For each cluster, how many clusters starting from it follow each 
+        other both in the chain and on disk (up to FAT16_MAX_RUN). A run 
+        of N clusters can be read with a single disk access. Free clusters 
+        have a run of 0
+    */
+    uint8_t *runs;
+    // Direct-mapped cache of directory lookups, indexed by a hash of the key
+    struct FAT16Dentry *dcache;
 } __attribute__((packed));
 
 typedef struct FAT16FileSystem FAT16FileSystem;
@@ -116,6 +191,8 @@ typedef struct FAT16FileSystem FAT16FileSystem;
     Represents the status of a file that is being read
 */
 struct FAT16FileHandle {
+    // The file system the file belongs to
+    FAT16FileSystem *fs;
     // The cluster at which the file content starts. Used for rewinding
     int initialCluster;
     // The position in the file
@@ -124,25 +201,53 @@ struct FAT16FileHandle {
     int cluster;
     // The size(bytes) of the file. Used to avoid reading outside the file data
     int filesize;
+    // The cluster before 'cluster' in the chain, 0 if 'cluster' is the first
+    int prevCluster;
+    // The disk offset of the file entry in its directory
+    int entryOffset;
+    // The VFS_MODE_* flags the file was opened with
+    int flags;
+    // Set when the size or the first cluster changed and the entry needs to be updated
+    bool dirty;
+    // A copy of 'cachedCluster', used for reads smaller than a cluster. NULL until needed
+    char *clusterCache;
+    // The cluster held in 'clusterCache', 0 if none
+    int cachedCluster;
+    /*
+        clusterIndex[i] is the cluster number of the (i * indexStride)th 
+        cluster of the file, for i < indexed. Used to seek without walking 
+        the chain from the start. When all slots are used the stride is 
+        doubled and every other slot is dropped
+    */
+    int clusterIndex[FAT16_INDEX_SLOTS];
+    int indexStride;
+    int indexed;
 };
 
 typedef struct FAT16FileHandle FAT16FileHandle;
 
-void fat16_set_diskinterface(struct DiskInterface *diskinterface);
-int fat16_read_cluster(int cluster, char *buffer);
+int fat16_read_cluster(FAT16FileSystem *fs, int cluster, char *buffer);
 
-int fat16_open_support(const char *path, int length, FAT16DirEntry *entry);
+int fat16_open_support(FAT16FileSystem *fs, const char *path, int length, FAT16DirEntry *entry, int *entryoff);
 
-int fat16_read_filesystem(struct DiskInterface *diskinterface);
-int fat16_ls(int *offset, FAT16DirEntry *out, char *filename);
-int fat16_open(const char *path, FAT16DirEntry *entry);
-int fat16_fopen(const char *path, char mode, struct FAT16FileHandle *handle);
+int fat16_read_filesystem(FAT16FileSystem *fs, struct DiskInterface *diskinterface);
+int fat16_ls(FAT16FileSystem *fs, int *offset, FAT16DirEntry *out, char *filename);
+int fat16_open(FAT16FileSystem *fs, const char *path, FAT16DirEntry *entry);
+int fat16_fopen(FAT16FileSystem *fs, const char *path, int flags, struct FAT16FileHandle *handle);
 int fat16_fread(struct FAT16FileHandle *handle, int count, char *buffer);
+int fat16_fwrite(struct FAT16FileHandle *handle, int count, char *buffer);
+int fat16_fwritev(struct FAT16FileHandle *handle, struct IOVec *iov, int iovcount);
+int fat16_ftruncate(struct FAT16FileHandle *handle, int size);
+int fat16_fseek(struct FAT16FileHandle *handle, int position);
+int fat16_fclose(struct FAT16FileHandle *handle);
+int fat16_unlink(FAT16FileSystem *fs, const char *path);
+int fat16_flush(FAT16FileSystem *fs);
 
 int fat16_is_entry_end(FAT16DirEntry *entry);
 int fat16_is_entry_unused(FAT16DirEntry *entry);
-int fat16_get_next_cluster(int cluster);
-int fat16_cluster_to_offset(int cluster);
+int fat16_get_next_cluster(FAT16FileSystem *fs, int cluster);
+int fat16_get_run(FAT16FileSystem *fs, int cluster);
+int fat16_cluster_to_offset(FAT16FileSystem *fs, int cluster);
 
 int fat16_get_formatted_filename(unsigned char *, unsigned char *);
 
@@ -9,35 +9,55 @@
 #include <klibc/string.h>
 
 
-static VFSInterface vfsinterface;
-
-
+/*
+    Mounts the FAT16 file system on the disk, returning a new interface for 
+    it. Each call creates a separate instance, so more disks can be used at 
+    the same time.
+    Returns NULL if the disk doesn't contain a FAT16 file system
+*/
 struct VFSInterface *fat16_get_vfsinterface(struct DiskInterface *diskinterface)
 {
-    if (vfsinterface.fopen == 0) {
-        int result = fat16_read_filesystem(diskinterface);
-        if (result < 0) return NULL;
-        vfsinterface = (struct VFSInterface) {
-            .fopen = &fat16vfs_fopen,
-            .fread = &fat16vfs_fread,
-            .fwrite = &fat16vfs_fwrite,
-            .fclose = &fat16vfs_fclose,
-            .opendir = &fat16vfs_opendir,
-            .listdir = &fat16vfs_listdir,
-            .closedir = &fat16vfs_closedir
-        };
+    FAT16FileSystem *fs = (FAT16FileSystem *) kmalloc(sizeof(FAT16FileSystem));
+    if (fs == NULL)     return NULL;
+    VFSInterface *vfsinterface = (VFSInterface *) kmalloc(sizeof(VFSInterface));
+    if (vfsinterface == NULL) {
+        kfree(fs);
+        return NULL;
     }
 
-    return &vfsinterface;
+    if (fat16_read_filesystem(fs, diskinterface) < 0) {
+        kfree(fs);
+        kfree(vfsinterface);
+        return NULL;
+    }
+    *vfsinterface = (struct VFSInterface) {
+        .filesystem = "fat16",
+        .fs_defined = fs,
+        .usePageCache = true,
+        .fopen = &fat16vfs_fopen,
+        .fread = &fat16vfs_fread,
+        .fwrite = &fat16vfs_fwrite,
+        .fwritev = &fat16vfs_fwritev,
+        .fclose = &fat16vfs_fclose,
+        .ftruncate = &fat16vfs_ftruncate,
+        .fseek = &fat16vfs_fseek,
+        .ftell = &fat16vfs_ftell,
+        .unlink = &fat16vfs_unlink,
+        .opendir = &fat16vfs_opendir,
+        .listdir = &fat16vfs_listdir,
+        .closedir = &fat16vfs_closedir
+    };
+
+    return vfsinterface;
 }
 
-int fat16vfs_fopen(char *path, File *out)
+int fat16vfs_fopen(VFSInterface *vfs, char *path, int flags, File *out)
 {
     struct FAT16FileHandle *handle;
     handle = (struct FAT16FileHandle *) kmalloc(sizeof(struct FAT16FileHandle));
     if (handle == 0)    return -2;
 
-    if (fat16_fopen(path, 'r', handle) != 0) {
+    if (fat16_fopen(vfs->fs_defined, path, flags, handle) != 0) {
         kfree(handle);
         return -1;
     }
@@ -57,6 +77,7 @@ int fat16vfs_fopen(char *path, File *out)
     out->name[filename_len] = '\0';
     // TODO: This is horrible
     out->filesize = handle->filesize;
+    out->id = handle->entryOffset;
     out->fs_defined = handle;
 
     return 0;
@@ -72,23 +93,63 @@ int fat16vfs_fread(char *buffer, int count, File *file)
 
 int fat16vfs_fwrite(char *buffer, int count, File *file)
 {
-    (void) buffer;
-    (void) count;
-    (void) file;
-    // TODO: Implement
-    return -1;
+    struct FAT16FileHandle *handle;
+    handle = (struct FAT16FileHandle *) file->fs_defined;
+
+    int written = fat16_fwrite(handle, count, buffer);
+    file->filesize = handle->filesize;
+
+    return written;
+}
+
+int fat16vfs_fwritev(File *file, struct IOVec *iov, int count)
+{
+    struct FAT16FileHandle *handle;
+    handle = (struct FAT16FileHandle *) file->fs_defined;
+
+    int written = fat16_fwritev(handle, iov, count);
+    file->filesize = handle->filesize;
+
+    return written;
 }
 
 int fat16vfs_fclose(File *file)
 {
+    int result = fat16_fclose((struct FAT16FileHandle *) file->fs_defined);
     kfree(file->fs_defined);
-    return 0;
+    return result;
+}
+
+int fat16vfs_ftruncate(File *file, int size)
+{
+    struct FAT16FileHandle *handle;
+    handle = (struct FAT16FileHandle *) file->fs_defined;
+
+    int result = fat16_ftruncate(handle, size);
+    file->filesize = handle->filesize;
+
+    return result;
+}
+
+int fat16vfs_fseek(File *file, int position)
+{
+    return fat16_fseek((struct FAT16FileHandle *) file->fs_defined, position);
+}
+
+int fat16vfs_ftell(File *file)
+{
+    return ((struct FAT16FileHandle *) file->fs_defined)->position;
+}
+
+int fat16vfs_unlink(VFSInterface *vfs, char *path)
+{
+    return fat16_unlink(vfs->fs_defined, path);
 }
 
-int fat16vfs_opendir(char *path, Dir *out)
+int fat16vfs_opendir(VFSInterface *vfs, char *path, Dir *out)
 {
     FAT16DirEntry folder;
-    int offset = fat16_open(path, &folder);
+    int offset = fat16_open(vfs->fs_defined, path, &folder);
     // The root is not a dir in FAT, but we want to consider it so
     int is_dir = !strcmp("/", path) || folder.attributes & FAT_ATTR_DIRECTORY;
     if (offset < 0 || !is_dir)
@@ -103,7 +164,7 @@ int fat16vfs_listdir(Dir *dir, DirEntry *entry)
 {
     int offset = (int) dir->fs_defined;
     FAT16DirEntry fatentry;
-    int result = fat16_ls(&offset, &fatentry, entry->name);
+    int result = fat16_ls(dir->vfs->fs_defined, &offset, &fatentry, entry->name);
     if (result == 0)
         return 0;
 
@@ -2,15 +2,21 @@
 #define FAT16VFS_H
 
 #include <kernel/filesystems/vfs.h>
+#include <kernel/devices/vdisk.h>
 
-struct VFSInterface *fat16_get_vfsinterface();
+struct VFSInterface *fat16_get_vfsinterface(struct DiskInterface *diskinterface);
 
-int fat16vfs_fopen(char *path, File *out);
+int fat16vfs_fopen(VFSInterface *vfs, char *path, int flags, File *out);
 int fat16vfs_fread(char *buffer, int count, File *file);
 int fat16vfs_fwrite(char *buffer, int count, File *file);
+int fat16vfs_fwritev(File *file, struct IOVec *iov, int count);
 int fat16vfs_fclose(File *file);
+int fat16vfs_ftruncate(File *file, int size);
+int fat16vfs_fseek(File *file, int position);
+int fat16vfs_ftell(File *file);
+int fat16vfs_unlink(VFSInterface *vfs, char *path);
 
-int fat16vfs_opendir(char *path, Dir *out);
+int fat16vfs_opendir(VFSInterface *vfs, char *path, Dir *out);
 int fat16vfs_listdir(Dir *dir, DirEntry *entry);
 int fat16vfs_closedir(Dir *dir);
 
@@ -0,0 +1,376 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <kernel/filesystems/pagecache.h>
+#include <kernel/filesystems/vfs.h>
+#include <kernel/arch/i386/paging.h>
+#include <kernel/lib/kassert.h>
+#include <kernel/lib/util.h>
+#include <klibc/string.h>
+
+#define PAGECACHE_DESCS_PER_PAGE (PGSIZE / sizeof(struct CachedPage))
+
+
+static struct CachedPage *buckets[PAGECACHE_BUCKETS];
+static struct CachedPage *free_descs;
+static struct CachedPage *lru_head, *lru_tail;
+
+static struct CachedPage **pagecache_bucket(VFSInterface *vfs, uint32_t fileId, int index)
+{
+    uint32_t hash = (uint32_t) vfs ^ (fileId * 31) ^ ((uint32_t) index * 2654435761U);
+
+    return &buckets[(hash >> 8) % PAGECACHE_BUCKETS];
+}
+
+/*
+    Returns the cached 'index'th page of the file, NULL if it is not cached
+*/
+static struct CachedPage *pagecache_lookup(FileDesc fd, int index)
+{
+    struct CachedPage *page = *pagecache_bucket(fd->vfs, fd->id, index);
+    while (page != NULL) {
+        if (page->vfs == fd->vfs && page->fileId == fd->id && page->index == index)
+            return page;
+        page = page->next;
+    }
+
+    return NULL;
+}
+
+/*
+    Takes an unused page descriptor, descriptors are carved from whole pages
+    and never given back. Returns NULL if there is no memory
+*/
+static struct CachedPage *pagecache_alloc_desc(void)
+{
+    if (free_descs == NULL) {
+        struct PageInfo *page = page_alloc(1);
+        if (page == NULL)
+            return NULL;
+        struct CachedPage *descs = (struct CachedPage *) page2addr(page);
+        for (unsigned i = 0; i < PAGECACHE_DESCS_PER_PAGE; i++) {
+            descs[i].next = free_descs;
+            free_descs = &descs[i];
+        }
+    }
+
+    struct CachedPage *desc = free_descs;
+    free_descs = desc->next;
+    memset(desc, 0, sizeof(struct CachedPage));
+
+    return desc;
+}
+
+static void pagecache_free_desc(struct CachedPage *page)
+{
+    page->next = free_descs;
+    free_descs = page;
+}
+
+static void pagecache_lru_remove(struct CachedPage *page)
+{
+    if (page->lruPrev != NULL)
+        page->lruPrev->lruNext = page->lruNext;
+    else
+        lru_head = page->lruNext;
+    if (page->lruNext != NULL)
+        page->lruNext->lruPrev = page->lruPrev;
+    else
+        lru_tail = page->lruPrev;
+    page->lruPrev = page->lruNext = NULL;
+}
+
+static void pagecache_lru_push(struct CachedPage *page)
+{
+    page->lruPrev = NULL;
+    page->lruNext = lru_head;
+    if (lru_head != NULL)
+        lru_head->lruPrev = page;
+    else
+        lru_tail = page;
+    lru_head = page;
+}
+
+/*
+    Removes a page from its hash bucket, the page stays valid for the users
+    that still hold a reference to it
+*/
+static void pagecache_unhash(struct CachedPage *page)
+{
+    struct CachedPage **link = pagecache_bucket(page->vfs, page->fileId, page->index);
+    while (*link != page) {
+        kassert(*link != NULL);
+        link = &(*link)->next;
+    }
+    *link = page->next;
+    page->next = NULL;
+    page->hashed = false;
+}
+
+/*
+    Removes a page from the cache. If nobody is using it it is freed right
+    away, otherwise when the last reference is dropped
+*/
+static void pagecache_evict(struct CachedPage *page)
+{
+    pagecache_unhash(page);
+    if (page->refs == 0) {
+        pagecache_lru_remove(page);
+        page_free(addr2page(page->addr));
+        pagecache_free_desc(page);
+    }
+}
+
+/*
+    Calls 'action' on every cached page of the file whose index is at least
+    'first'. The next page is read before calling it, so 'action' can evict
+*/
+static void pagecache_foreach(
+    VFSInterface *vfs,
+    uint32_t fileId,
+    int first,
+    void (*action)(struct CachedPage *, void *),
+    void *arg)
+{
+    for (int i = 0; i < PAGECACHE_BUCKETS; i++) {
+        struct CachedPage *page = buckets[i];
+        while (page != NULL) {
+            struct CachedPage *next = page->next;
+            if (page->vfs == vfs && page->fileId == fileId && page->index >= first)
+                action(page, arg);
+            page = next;
+        }
+    }
+}
+
+/*
+    Reads from the file the part of the page that is not filled yet. The
+    read goes straight to the file system, the cursor of the file is not
+    moved
+*/
+static void pagecache_fill(FileDesc fd, struct CachedPage *page)
+{
+    const int start = page->index * PGSIZE;
+    const int wanted = MIN(PGSIZE, fd->filesize - start);
+    if (wanted <= page->filled)
+        return;
+
+    int saved = fd->vfs->ftell(fd);
+    int read = 0;
+    if (fd->vfs->fseek(fd, start + page->filled) >= 0)
+        read = fd->vfs->fread((char *) page->addr + page->filled, wanted - page->filled, fd);
+    fd->vfs->fseek(fd, saved);
+    if (read > 0)
+        page->filled += read;
+}
+
+static void pagecache_hash(struct CachedPage *page)
+{
+    struct CachedPage **bucket = pagecache_bucket(page->vfs, page->fileId, page->index);
+    page->hashed = true;
+    page->next = *bucket;
+    *bucket = page;
+}
+
+struct CachedPage *pagecache_get(FileDesc fd, int index)
+{
+    struct CachedPage *page = pagecache_lookup(fd, index);
+    if (page != NULL) {
+        if (page->refs == 0)
+            pagecache_lru_remove(page);
+        page->refs++;
+        // The file might have grown since the page was read
+        pagecache_fill(fd, page);
+        return page;
+    }
+
+    page = pagecache_alloc_desc();
+    if (page == NULL)
+        return NULL;
+    struct PageInfo *frame = page_alloc(1);
+    if (frame == NULL) {
+        pagecache_free_desc(page);
+        return NULL;
+    }
+    page->vfs = fd->vfs;
+    page->fileId = fd->id;
+    page->index = index;
+    page->refs = 1;
+    page->addr = page2addr(frame);
+    memset(page->addr, 0, PGSIZE);
+    pagecache_fill(fd, page);
+
+    // Filling the page can reclaim memory, so the page is hashed only now
+    pagecache_hash(page);
+
+    return page;
+}
+
+void pagecache_put(struct CachedPage *page)
+{
+    kassert(page->refs > 0);
+    page->refs--;
+    if (page->refs > 0)
+        return;
+
+    if (page->hashed) {
+        pagecache_lru_push(page);
+    } else {
+        page_free(addr2page(page->addr));
+        pagecache_free_desc(page);
+    }
+}
+
+/*
+    Reads the pages of the file from 'index' on that are not cached yet, up
+    to 'count' of them, with one read from the file system into contiguous
+    frames. The pages are left in the cache unused.
+    Returns the number of pages read
+*/
+static int pagecache_readahead(FileDesc fd, int index, int count)
+{
+    struct CachedPage *descs[PAGECACHE_READAHEAD_MAX];
+    const int start = index * PGSIZE;
+    const int pages_left = (fd->filesize - start + PGSIZE - 1) / PGSIZE;
+    count = MIN(MIN(count, PAGECACHE_READAHEAD_MAX), pages_left);
+    for (int i = 1; i < count; i++) {
+        if (pagecache_lookup(fd, index + i) != NULL) {
+            count = i;
+            break;
+        }
+    }
+
+    /*
+        Halve the batch until there is a contiguous area for it. The cache 
+        is not shrunk to make room for pages that might never be read
+    */
+    struct PageInfo *frames = NULL;
+    while (count > 1 && (frames = page_try_alloc(count)) == NULL)
+        count /= 2;
+    if (frames == NULL)
+        return 0;
+    for (int i = 0; i < count; i++) {
+        descs[i] = pagecache_alloc_desc();
+        if (descs[i] == NULL) {
+            for (int k = 0; k < i; k++)
+                pagecache_free_desc(descs[k]);
+            for (int k = 0; k < count; k++)
+                page_free(&frames[k]);
+            return 0;
+        }
+    }
+
+    char *data = (char *) page2addr(frames);
+    int saved = fd->vfs->ftell(fd);
+    int read = 0;
+    if (fd->vfs->fseek(fd, start) >= 0)
+        read = fd->vfs->fread(data, MIN(count * PGSIZE, fd->filesize - start), fd);
+    fd->vfs->fseek(fd, saved);
+    if (read < 0)
+        read = 0;
+    memset(data + read, 0, count * PGSIZE - read);
+
+    for (int i = 0; i < count; i++) {
+        struct CachedPage *page = descs[i];
+        page->vfs = fd->vfs;
+        page->fileId = fd->id;
+        page->index = index + i;
+        page->addr = data + i * PGSIZE;
+        page->filled = MAX(0, MIN(PGSIZE, read - i * PGSIZE));
+        pagecache_hash(page);
+        pagecache_lru_push(page);
+    }
+
+    return count;
+}
+
+int pagecache_read(FileDesc fd, char *buffer, int count, int offset)
+{
+    count = MIN(count, fd->filesize - offset);
+    if (count <= 0)
+        return 0;
+
+    // Reading where the last read ended, or in the same page, is sequential
+    const int first = offset / PGSIZE;
+    if (first == fd->lastPage || first == fd->lastPage + 1) {
+        if (fd->readahead == 0)
+            fd->readahead = PAGECACHE_READAHEAD_MIN;
+    } else {
+        fd->readahead = 0;
+    }
+
+    int read = 0;
+    while (read < count) {
+        const int index = (offset + read) / PGSIZE;
+        const int page_offset = (offset + read) % PGSIZE;
+        const int to_copy = MIN(PGSIZE - page_offset, count - read);
+        if (fd->readahead > 0 && pagecache_lookup(fd, index) == NULL) {
+            if (pagecache_readahead(fd, index, fd->readahead) > 1)
+                fd->readahead = MIN(fd->readahead * 2, PAGECACHE_READAHEAD_MAX);
+        }
+        struct CachedPage *page = pagecache_get(fd, index);
+        if (page == NULL)
+            break;
+        memcpy(buffer + read, (char *) page->addr + page_offset, to_copy);
+        pagecache_put(page);
+        read += to_copy;
+        fd->lastPage = index;
+    }
+
+    return read;
+}
+
+void pagecache_write(FileDesc fd, int offset, char *buffer, int count)
+{
+    int written = 0;
+    while (written < count) {
+        const int index = (offset + written) / PGSIZE;
+        const int page_offset = (offset + written) % PGSIZE;
+        const int to_copy = MIN(PGSIZE - page_offset, count - written);
+
+        struct CachedPage *page = pagecache_lookup(fd, index);
+        if (page != NULL) {
+            memcpy((char *) page->addr + page_offset, buffer + written, to_copy);
+            if (page_offset <= page->filled)
+                page->filled = MAX(page->filled, page_offset + to_copy);
+        }
+        written += to_copy;
+    }
+}
+
+static void pagecache_clear_tail(struct CachedPage *page, void *size)
+{
+    int from = *(int *) size - page->index * PGSIZE;
+    if (from <= 0) {
+        pagecache_evict(page);
+    } else if (from < PGSIZE) {
+        memset((char *) page->addr + from, 0, PGSIZE - from);
+        page->filled = MIN(page->filled, from);
+    }
+}
+
+void pagecache_truncate(FileDesc fd, int size)
+{
+    pagecache_foreach(fd->vfs, fd->id, size / PGSIZE, pagecache_clear_tail, &size);
+}
+
+static void pagecache_drop(struct CachedPage *page, __attribute__((unused)) void *arg)
+{
+    pagecache_evict(page);
+}
+
+void pagecache_invalidate(VFSInterface *vfs, uint32_t fileId)
+{
+    pagecache_foreach(vfs, fileId, 0, pagecache_drop, NULL);
+}
+
+size_t pagecache_reclaim(size_t count)
+{
+    size_t freed = 0;
+    while (freed < count && lru_tail != NULL) {
+        pagecache_evict(lru_tail);
+        freed++;
+    }
+
+    return freed;
+}
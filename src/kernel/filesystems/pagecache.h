@@ -0,0 +1,92 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <kernel/filesystems/vfs.h>
+
+#define PAGECACHE_BUCKETS   256
+
+/*
+    Read-ahead window, in pages. It starts at the minimum when a handle 
+    reads sequentially, doubles each time it is used and drops to 0 as 
+    soon as the handle reads somewhere else
+*/
+#define PAGECACHE_READAHEAD_MIN 4
+#define PAGECACHE_READAHEAD_MAX 32
+
+/*
+    A page of file data kept in memory, identified by the file system, the
+    file id and the index of the page in the file. Pages are shared by all
+    the handles and mappings of the same file, 'refs' counts who is using
+    the page right now. Pages nobody is using stay cached in LRU order until
+    the memory is needed, see pagecache_reclaim
+*/
+struct CachedPage {
+    VFSInterface *vfs;
+    uint32_t fileId;
+    int index;
+    int refs;
+    // How many bytes from the start of the page hold file data
+    int filled;
+    // Cleared when the page is dropped from the cache while still in use
+    bool hashed;
+    void *addr;
+    // The next page in the same hash bucket, also links the unused pages
+    struct CachedPage *next;
+    // The LRU list of the pages with no references, most recent first
+    struct CachedPage *lruPrev;
+    struct CachedPage *lruNext;
+};
+
+/*
+    Returns the 'index'th page of the file with a reference taken, reading it
+    from the file if it is not cached yet. The part of the page after the
+    end of the file is zeroed.
+    Returns NULL if there is no memory for the page
+*/
+struct CachedPage *pagecache_get(FileDesc fd, int index);
+
+/*
+    Drops a reference taken with pagecache_get. The page stays in the cache
+*/
+void pagecache_put(struct CachedPage *page);
+
+/*
+    Reads 'count' bytes of the file starting at 'offset' through the cache,
+    the file cursor is not used. When the handle is reading sequentially
+    the pages that follow are read too, in a single read from the file
+    system. Returns the number of bytes read, which is lower than 'count'
+    if the file ends first
+*/
+int pagecache_read(FileDesc fd, char *buffer, int count, int offset);
+
+/*
+    Copies 'count' bytes written at 'offset' in the file into its cached
+    pages, so that whoever uses them sees the new content. To be called
+    after the data was written to the file
+*/
+void pagecache_write(FileDesc fd, int offset, char *buffer, int count);
+
+/*
+    The file was shrunk to 'size' bytes: the cached data after the end is
+    zeroed and the pages after the end are dropped from the cache
+*/
+void pagecache_truncate(FileDesc fd, int size);
+
+/*
+    Drops all the cached pages of a file, to be called when the file is
+    deleted and its id could be reused
+*/
+void pagecache_invalidate(VFSInterface *vfs, uint32_t fileId);
+
+/*
+    Frees up to 'count' cached pages that nobody is using, the least
+    recently used first. Called by the page allocator when it runs out of
+    memory.
+    Returns the number of pages freed
+*/
+size_t pagecache_reclaim(size_t count);
+
+#endif
@@ -0,0 +1,523 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <kernel/arch/i386/paging.h>
+#include <kernel/filesystems/vfs.h>
+#include <kernel/filesystems/tmpfs/tmpfs.h>
+#include <kernel/lib/time.h>
+#include <kernel/lib/util.h>
+#include <kernel/memory/kheap.h>
+#include <klibc/string.h>
+
+
+#define TMPFS_NODES_PER_PAGE (PGSIZE / sizeof(struct TmpfsNode))
+
+/*
+    The position of a directory listing: the index of the next child
+*/
+struct TmpfsDirCursor {
+    struct TmpfsNode *dir;
+    int index;
+};
+
+/*
+    Allocates a zeroed page for file data or for the radix tree.
+    Returns its address, NULL if there is no free memory
+*/
+static void *tmpfs_alloc_page(struct Tmpfs *fs)
+{
+    struct PageInfo *page = page_alloc(1);
+    if (page == NULL)
+        return NULL;
+
+    void *addr = page2addr(page);
+    memset(addr, 0, PGSIZE);
+    fs->pages++;
+
+    return addr;
+}
+
+static void tmpfs_free_page(struct Tmpfs *fs, void *addr)
+{
+    page_free(addr2page(addr));
+    fs->pages--;
+}
+
+/*
+    Returns a zeroed node, taking it from the free list. When the list is
+    empty a new page is split into nodes.
+    Returns NULL if there is no free memory
+*/
+static struct TmpfsNode *tmpfs_alloc_node(struct Tmpfs *fs)
+{
+    if (fs->freeNodes == NULL) {
+        struct PageInfo *page = page_alloc(1);
+        if (page == NULL)
+            return NULL;
+        struct TmpfsNode *nodes = (struct TmpfsNode *) page2addr(page);
+        for (unsigned i = 0; i < TMPFS_NODES_PER_PAGE; i++) {
+            nodes[i].next = fs->freeNodes;
+            fs->freeNodes = &nodes[i];
+        }
+    }
+
+    struct TmpfsNode *node = fs->freeNodes;
+    fs->freeNodes = node->next;
+    memset(node, 0, sizeof(struct TmpfsNode));
+
+    return node;
+}
+
+/*
+    Frees a radix tree page and, if it is an index page ('level' > 0), all
+    the pages below it
+*/
+static void tmpfs_free_tree(struct Tmpfs *fs, void *page, int level)
+{
+    if (page == NULL)
+        return;
+
+    if (level > 0) {
+        void **slots = (void **) page;
+        for (int i = 0; i < TMPFS_RADIX_SLOTS; i++)
+            tmpfs_free_tree(fs, slots[i], level - 1);
+    }
+    tmpfs_free_page(fs, page);
+}
+
+static void tmpfs_free_node(struct Tmpfs *fs, struct TmpfsNode *node)
+{
+    tmpfs_free_tree(fs, node->root, node->height);
+    node->next = fs->freeNodes;
+    fs->freeNodes = node;
+}
+
+/*
+    Returns the number of data pages a radix tree of height 'height' can index
+*/
+static int tmpfs_capacity(int height)
+{
+    return 1 << (TMPFS_RADIX_BITS * height);
+}
+
+/*
+    Returns a pointer to the slot of the radix tree that holds the address
+    of the 'index'th data page of the file. If 'create' is true the tree is
+    grown and the missing index pages are allocated, the data page itself is
+    not allocated.
+    Returns NULL if the slot doesn't exist (and 'create' is false) or if
+    there is no memory to create it
+*/
+static void **tmpfs_slot(struct Tmpfs *fs, struct TmpfsNode *file, int index, bool create)
+{
+    // The tree is grown by adding a new root above the old one
+    while (file->height * TMPFS_RADIX_BITS < 31 && index >= tmpfs_capacity(file->height)) {
+        if (!create)
+            return NULL;
+        if (file->root != NULL) {
+            void **root = (void **) tmpfs_alloc_page(fs);
+            if (root == NULL)
+                return NULL;
+            root[0] = file->root;
+            file->root = root;
+        }
+        file->height++;
+    }
+
+    void **slot = &file->root;
+    for (int level = file->height; level > 0; level--) {
+        if (*slot == NULL) {
+            if (!create)
+                return NULL;
+            *slot = tmpfs_alloc_page(fs);
+            if (*slot == NULL)
+                return NULL;
+        }
+        int shift = (level - 1) * TMPFS_RADIX_BITS;
+        slot = &((void **) *slot)[(index >> shift) & (TMPFS_RADIX_SLOTS - 1)];
+    }
+
+    return slot;
+}
+
+/*
+    Shrinks a file to 'size' bytes, freeing the data pages after the end
+*/
+static void tmpfs_shrink(struct Tmpfs *fs, struct TmpfsNode *file, int size)
+{
+    if (size == 0) {
+        tmpfs_free_tree(fs, file->root, file->height);
+        file->root = NULL;
+        file->height = 0;
+        file->size = 0;
+        return;
+    }
+
+    const int keep = (size + PGSIZE - 1) / PGSIZE;
+    const int pages = (file->size + PGSIZE - 1) / PGSIZE;
+    for (int i = keep; i < pages; i++) {
+        void **slot = tmpfs_slot(fs, file, i, false);
+        if (slot != NULL && *slot != NULL) {
+            tmpfs_free_page(fs, *slot);
+            *slot = NULL;
+        }
+    }
+    // The rest of the last page is cleared, so that it reads as 0 if the file grows again
+    void **slot = tmpfs_slot(fs, file, keep - 1, false);
+    if (slot != NULL && *slot != NULL && size % PGSIZE != 0)
+        memset((char *) *slot + size % PGSIZE, 0, PGSIZE - size % PGSIZE);
+    file->size = size;
+}
+
+/*
+    Returns the child of 'dir' with the given name, which is 'length'
+    characters long and not necessarily null terminated.
+    Returns NULL if there is no such child
+*/
+static struct TmpfsNode *tmpfs_child(struct TmpfsNode *dir, const char *name, int length)
+{
+    for (struct TmpfsNode *c = dir->children; c != NULL; c = c->next) {
+        if ((int) strlen((char *) c->name) == length && !memcmp(c->name, name, length))
+            return c;
+    }
+
+    return NULL;
+}
+
+/*
+    Follows an absolute path from the root of the file system. If 'name' is
+    not NULL the last component is not followed: the directory containing
+    it is returned and 'name' is set to point to the component in 'path'.
+    Returns the node, NULL if the path doesn't exist
+*/
+static struct TmpfsNode *tmpfs_walk(struct Tmpfs *fs, const char *path, const char **name)
+{
+    if (path[0] != '/')
+        return NULL;
+
+    struct TmpfsNode *node = fs->root;
+    const char *component = path + 1;
+    while (*component != '\0') {
+        int length = 0;
+        while (component[length] != '\0' && component[length] != '/')
+            length++;
+
+        if (name != NULL && component[length] == '\0') {
+            *name = component;
+            return node;
+        }
+        if (node->type != DIRECTORY)
+            return NULL;
+        node = tmpfs_child(node, component, length);
+        if (node == NULL)
+            return NULL;
+
+        component += length;
+        if (*component == '/')
+            component++;
+    }
+    if (name != NULL)
+        *name = component;
+
+    return node;
+}
+
+/*
+    Creates an empty file or directory at 'path'. The parent directory must
+    exist already.
+    Returns the new node, NULL if the path is not valid, it already exists
+    or there is no free memory
+*/
+static struct TmpfsNode *tmpfs_create(struct Tmpfs *fs, const char *path, enum DirEntryType type)
+{
+    const char *name;
+    struct TmpfsNode *parent = tmpfs_walk(fs, path, &name);
+    if (parent == NULL || parent->type != DIRECTORY)
+        return NULL;
+
+    const int length = strlen(name);
+    if (length == 0 || length > VFS_NAME_LEN)
+        return NULL;
+    if (!strcmp(name, ".") || !strcmp(name, ".."))
+        return NULL;
+    for (int i = 0; i < length; i++) {
+        if (name[i] == '/')
+            return NULL;
+    }
+    if (tmpfs_child(parent, name, length) != NULL)
+        return NULL;
+
+    struct TmpfsNode *node = tmpfs_alloc_node(fs);
+    if (node == NULL)
+        return NULL;
+    strcpy((char *) node->name, name);
+    node->type = type;
+    get_datetime(&node->creation);
+    node->lastUpdate = node->creation;
+    node->parent = parent;
+    node->next = parent->children;
+    parent->children = node;
+
+    return node;
+}
+
+struct VFSInterface *tmpfs_get_vfsinterface(void)
+{
+    struct Tmpfs *fs = (struct Tmpfs *) kmalloc(sizeof(struct Tmpfs));
+    if (fs == NULL)     return NULL;
+    VFSInterface *vfsinterface = (VFSInterface *) kmalloc(sizeof(VFSInterface));
+    if (vfsinterface == NULL) {
+        kfree(fs);
+        return NULL;
+    }
+
+    fs->freeNodes = NULL;
+    fs->pages = 0;
+    fs->root = tmpfs_alloc_node(fs);
+    if (fs->root == NULL) {
+        kfree(fs);
+        kfree(vfsinterface);
+        return NULL;
+    }
+    fs->root->type = DIRECTORY;
+    get_datetime(&fs->root->creation);
+    fs->root->lastUpdate = fs->root->creation;
+
+    *vfsinterface = (struct VFSInterface) {
+        .filesystem = "tmpfs",
+        .fs_defined = fs,
+        .fopen = &tmpfs_fopen,
+        .fread = &tmpfs_fread,
+        .fwrite = &tmpfs_fwrite,
+        .fclose = &tmpfs_fclose,
+        .ftruncate = &tmpfs_ftruncate,
+        .fseek = &tmpfs_fseek,
+        .ftell = &tmpfs_ftell,
+        .makedir = &tmpfs_makedir,
+        .unlink = &tmpfs_unlink,
+        .opendir = &tmpfs_opendir,
+        .listdir = &tmpfs_listdir,
+        .closedir = &tmpfs_closedir
+    };
+
+    return vfsinterface;
+}
+
+int tmpfs_fopen(VFSInterface *vfs, char *path, int flags, File *out)
+{
+    struct Tmpfs *fs = (struct Tmpfs *) vfs->fs_defined;
+    struct TmpfsNode *node = tmpfs_walk(fs, path, NULL);
+    if (node == NULL) {
+        if (!(flags & VFS_MODE_CREATE))
+            return -1;
+        node = tmpfs_create(fs, path, FILE);
+        if (node == NULL)
+            return -1;
+    }
+    if (node->type != FILE)
+        return -1;
+
+    struct TmpfsHandle *handle;
+    handle = (struct TmpfsHandle *) kmalloc(sizeof(struct TmpfsHandle));
+    if (handle == NULL)     return -2;
+    handle->node = node;
+    handle->position = 0;
+    handle->flags = flags;
+    node->openCount++;
+
+    if (flags & VFS_MODE_TRUNCATE && node->size > 0) {
+        tmpfs_shrink(fs, node, 0);
+        get_datetime(&node->lastUpdate);
+    }
+
+    strcpy((char *) out->name, (char *) node->name);
+    out->filesize = node->size;
+    out->id = (uint32_t) node;
+    out->fs_defined = handle;
+
+    return 0;
+}
+
+int tmpfs_fread(char *buffer, int count, File *file)
+{
+    struct TmpfsHandle *handle = (struct TmpfsHandle *) file->fs_defined;
+    struct Tmpfs *fs = (struct Tmpfs *) file->vfs->fs_defined;
+    struct TmpfsNode *node = handle->node;
+
+    count = MIN(count, node->size - handle->position);
+    int copied = 0;
+    while (copied < count) {
+        const int page_offset = handle->position % PGSIZE;
+        const int to_copy = MIN(PGSIZE - page_offset, count - copied);
+        void **slot = tmpfs_slot(fs, node, handle->position / PGSIZE, false);
+        if (slot != NULL && *slot != NULL)
+            memcpy(buffer + copied, (char *) *slot + page_offset, to_copy);
+        else
+            memset(buffer + copied, 0, to_copy);
+
+        copied += to_copy;
+        handle->position += to_copy;
+    }
+
+    return copied;
+}
+
+int tmpfs_fwrite(char *buffer, int count, File *file)
+{
+    struct TmpfsHandle *handle = (struct TmpfsHandle *) file->fs_defined;
+    struct Tmpfs *fs = (struct Tmpfs *) file->vfs->fs_defined;
+    struct TmpfsNode *node = handle->node;
+    if (!(handle->flags & VFS_MODE_WRITE))
+        return -1;
+
+    if (handle->flags & VFS_MODE_APPEND)
+        handle->position = node->size;
+
+    int written = 0;
+    while (written < count) {
+        const int page_offset = handle->position % PGSIZE;
+        const int to_copy = MIN(PGSIZE - page_offset, count - written);
+        void **slot = tmpfs_slot(fs, node, handle->position / PGSIZE, true);
+        if (slot == NULL)
+            break;
+        if (*slot == NULL) {
+            *slot = tmpfs_alloc_page(fs);
+            if (*slot == NULL)
+                break;
+        }
+        memcpy((char *) *slot + page_offset, buffer + written, to_copy);
+
+        written += to_copy;
+        handle->position += to_copy;
+        if (handle->position > node->size)
+            node->size = handle->position;
+    }
+    if (written > 0)
+        get_datetime(&node->lastUpdate);
+    file->filesize = node->size;
+
+    return written;
+}
+
+int tmpfs_fclose(File *file)
+{
+    struct TmpfsHandle *handle = (struct TmpfsHandle *) file->fs_defined;
+    struct Tmpfs *fs = (struct Tmpfs *) file->vfs->fs_defined;
+    struct TmpfsNode *node = handle->node;
+
+    node->openCount--;
+    if (node->unlinked && node->openCount == 0)
+        tmpfs_free_node(fs, node);
+    kfree(handle);
+
+    return 0;
+}
+
+int tmpfs_ftruncate(File *file, int size)
+{
+    struct TmpfsHandle *handle = (struct TmpfsHandle *) file->fs_defined;
+    struct Tmpfs *fs = (struct Tmpfs *) file->vfs->fs_defined;
+    struct TmpfsNode *node = handle->node;
+    if (!(handle->flags & VFS_MODE_WRITE))
+        return -1;
+    if (size < 0 || size > node->size)
+        return -1;
+
+    tmpfs_shrink(fs, node, size);
+    get_datetime(&node->lastUpdate);
+    if (handle->position > size)
+        handle->position = size;
+    file->filesize = size;
+
+    return 0;
+}
+
+int tmpfs_fseek(File *file, int position)
+{
+    struct TmpfsHandle *handle = (struct TmpfsHandle *) file->fs_defined;
+    if (position < 0 || position > handle->node->size)
+        return -1;
+    handle->position = position;
+
+    return position;
+}
+
+int tmpfs_ftell(File *file)
+{
+    return ((struct TmpfsHandle *) file->fs_defined)->position;
+}
+
+int tmpfs_makedir(VFSInterface *vfs, char *path)
+{
+    struct Tmpfs *fs = (struct Tmpfs *) vfs->fs_defined;
+    return tmpfs_create(fs, path, DIRECTORY) != NULL ? 0 : -1;
+}
+
+int tmpfs_unlink(VFSInterface *vfs, char *path)
+{
+    struct Tmpfs *fs = (struct Tmpfs *) vfs->fs_defined;
+    struct TmpfsNode *node = tmpfs_walk(fs, path, NULL);
+    if (node == NULL || node->type != FILE)
+        return -1;
+
+    struct TmpfsNode **link = &node->parent->children;
+    while (*link != node)
+        link = &(*link)->next;
+    *link = node->next;
+    get_datetime(&node->parent->lastUpdate);
+
+    if (node->openCount > 0)
+        node->unlinked = true;
+    else
+        tmpfs_free_node(fs, node);
+
+    return 0;
+}
+
+int tmpfs_opendir(VFSInterface *vfs, char *path, Dir *out)
+{
+    struct Tmpfs *fs = (struct Tmpfs *) vfs->fs_defined;
+    struct TmpfsNode *node = tmpfs_walk(fs, path, NULL);
+    if (node == NULL || node->type != DIRECTORY)
+        return -1;
+
+    struct TmpfsDirCursor *cursor;
+    cursor = (struct TmpfsDirCursor *) kmalloc(sizeof(struct TmpfsDirCursor));
+    if (cursor == NULL)
+        return -1;
+    cursor->dir = node;
+    cursor->index = 0;
+    strcpy((char *) out->name, (char *) node->name);
+    out->fs_defined = cursor;
+
+    return 0;
+}
+
+/*
+    The cursor keeps the index of the next child instead of a pointer to it,
+    so that deleting files while listing a directory is safe
+*/
+int tmpfs_listdir(Dir *dir, DirEntry *entry)
+{
+    struct TmpfsDirCursor *cursor = (struct TmpfsDirCursor *) dir->fs_defined;
+    struct TmpfsNode *node = cursor->dir->children;
+    for (int i = 0; i < cursor->index && node != NULL; i++)
+        node = node->next;
+    if (node == NULL)
+        return 0;
+
+    cursor->index++;
+    strcpy((char *) entry->name, (char *) node->name);
+    entry->type = node->type;
+    entry->creation = node->creation;
+    entry->lastUpdate = node->lastUpdate;
+    entry->fs_defined = node;
+
+    return 1;
+}
+
+int tmpfs_closedir(Dir *dir)
+{
+    kfree(dir->fs_defined);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/lib/time.h>
+#include <kernel/filesystems/vfs.h>
+
+/*
+    File data is stored in pages taken directly from the page allocator. 
+    Each file has a radix tree indexing its pages: with a height of 0 the 
+    root is the only data page, otherwise it is an index page with 
+    TMPFS_RADIX_SLOTS pointers to the pages of the level below
+*/
+#define TMPFS_RADIX_BITS    10
+#define TMPFS_RADIX_SLOTS   (1 << TMPFS_RADIX_BITS)
+
+/*
+    A file or a directory in the tmpfs
+*/
+struct TmpfsNode {
+    unsigned char name[VFS_NAME_LEN + 1];
+    enum DirEntryType type;
+    struct DateTime creation;
+    struct DateTime lastUpdate;
+    // The size in bytes of a file
+    int size;
+    // Height and root of the radix tree of the file pages
+    int height;
+    void *root;
+    // The directory tree. 'next' also links the unused nodes
+    struct TmpfsNode *parent;
+    struct TmpfsNode *children;
+    struct TmpfsNode *next;
+    // How many handles have the file open
+    int openCount;
+    // Set when the file was deleted while still open, it is freed on close
+    bool unlinked;
+};
+
+/*
+    An instance of a tmpfs. Nodes are carved from whole pages and kept in 
+    a free list when deleted
+*/
+struct Tmpfs {
+    struct TmpfsNode *root;
+    struct TmpfsNode *freeNodes;
+    // Pages currently used for file data and radix tree index pages
+    int pages;
+};
+
+struct TmpfsHandle {
+    struct TmpfsNode *node;
+    int position;
+    // The VFS_MODE_* flags the file was opened with
+    int flags;
+};
+
+/*
+    Creates a new empty tmpfs.
+    Returns its interface, NULL if there is not enough memory
+*/
+struct VFSInterface *tmpfs_get_vfsinterface(void);
+
+int tmpfs_fopen(VFSInterface *vfs, char *path, int flags, File *out);
+int tmpfs_fread(char *buffer, int count, File *file);
+int tmpfs_fwrite(char *buffer, int count, File *file);
+int tmpfs_fclose(File *file);
+int tmpfs_ftruncate(File *file, int size);
+int tmpfs_fseek(File *file, int position);
+int tmpfs_ftell(File *file);
+int tmpfs_makedir(VFSInterface *vfs, char *path);
+int tmpfs_unlink(VFSInterface *vfs, char *path);
+
+int tmpfs_opendir(VFSInterface *vfs, char *path, Dir *out);
+int tmpfs_listdir(Dir *dir, DirEntry *entry);
+int tmpfs_closedir(Dir *dir);
+
+#endif
@@ -2,64 +2,372 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <kernel/filesystems/vfs.h>
+#include <kernel/filesystems/pagecache.h>
 #include <kernel/memory/kheap.h>
+#include <kernel/lib/util.h>
+#include <klibc/string.h>
 
 
-static VFSInterface *rootvfs;
+struct Mount {
+    char path[VFS_MOUNT_PATH_LEN];
+    int length;
+    VFSInterface *vfs;
+};
 
-int vfs_setroot(VFSInterface *vfsinterface)
+static struct Mount mounts[VFS_MAX_MOUNTS];
+
+int vfs_mount(char *path, VFSInterface *vfs)
 {
-    rootvfs = vfsinterface;
+    int length = strlen(path);
+    if (path[0] != '/' || length >= VFS_MOUNT_PATH_LEN) {
+        return -1;
+    }
+    if (length > 1 && path[length - 1] == '/') {
+        return -1;
+    }
+
+    struct Mount *free_mount = NULL;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (mounts[i].vfs == NULL) {
+            if (free_mount == NULL)
+                free_mount = &mounts[i];
+        } else if (!strcmp(mounts[i].path, path)) {
+            return -1;
+        }
+    }
+    if (free_mount == NULL) {
+        return -1;
+    }
+    strcpy(free_mount->path, path);
+    free_mount->length = length;
+    free_mount->vfs = vfs;
+
     return 0;
 }
 
+int vfs_umount(char *path)
+{
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (mounts[i].vfs != NULL && !strcmp(mounts[i].path, path)) {
+            mounts[i].vfs = NULL;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int vfs_setroot(VFSInterface *vfsinterface)
+{
+    return vfs_mount("/", vfsinterface);
+}
+
+/*
+    Finds the file system that handles 'path', the one mounted on the 
+    longest prefix of it. 'fspath' is set to the rest of the path, which is 
+    what the file system expects.
+    Returns the file system, NULL if no file system handles the path
+*/
+static VFSInterface *vfs_resolve(char *path, char **fspath)
+{
+    struct Mount *best = NULL;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        struct Mount *m = &mounts[i];
+        if (m->vfs == NULL || (best != NULL && m->length <= best->length)) {
+            continue;
+        }
+        if (m->length == 1) {
+            // The root matches every absolute path
+            if (path[0] == '/')
+                best = m;
+            continue;
+        }
+        // memcmp stops at the first difference, at the latest the end of 'path'
+        if (!memcmp(path, m->path, m->length) && 
+                (path[m->length] == '/' || path[m->length] == '\0')) {
+            best = m;
+        }
+    }
+    if (best == NULL) {
+        return NULL;
+    }
+
+    if (best->length == 1) {
+        *fspath = path;
+    } else if (path[best->length] == '\0') {
+        *fspath = "/";
+    } else {
+        *fspath = &path[best->length];
+    }
+
+    return best->vfs;
+}
+
+/*
+    Converts a mode string as the one passed to kfopen into VFS_MODE_* flags.
+    Returns the flags on success, -1 if the mode string is not valid
+*/
+static int vfs_parse_mode(char *mode)
+{
+    int flags;
+    switch (mode[0]) {
+    case 'r':
+        flags = VFS_MODE_READ;
+        break;
+    case 'w':
+        flags = VFS_MODE_WRITE | VFS_MODE_CREATE | VFS_MODE_TRUNCATE;
+        break;
+    case 'a':
+        flags = VFS_MODE_WRITE | VFS_MODE_CREATE | VFS_MODE_APPEND;
+        break;
+    default:
+        return -1;
+    }
+
+    if (mode[1] == '+') {
+        flags |= VFS_MODE_READ | VFS_MODE_WRITE;
+    } else if (mode[1] != '\0') {
+        return -1;
+    }
+
+    return flags;
+}
+
 FileDesc kfopen(char *path, char *mode)
 {
-    (void) mode;
     // TODO: Check if the file is already opened for write
     // if we want to open for read, or if it is already opened for read if we 
     // want to write. 
+    int flags = vfs_parse_mode(mode);
+    if (flags < 0) {
+        return NULL;
+    }
+    char *fspath;
+    VFSInterface *vfs = vfs_resolve(path, &fspath);
+    if (vfs == NULL) {
+        return NULL;
+    }
     File *file = (File *) kmalloc(sizeof(File));
     if (file == NULL) {
         return NULL;
     }
-    int result = rootvfs->fopen(path, file);
+    file->vfs = vfs;
+    file->lastPage = -1;
+    file->readahead = 0;
+    int result = vfs->fopen(vfs, fspath, flags, file);
     if (result != 0) {
         kfree(file);
         return NULL;
     }
+    if (flags & VFS_MODE_TRUNCATE) {
+        pagecache_truncate(file, 0);
+    }
 
     return file;
 }
 
 int kfread(char *buffer, int count, FileDesc fd)
 {
-    return rootvfs->fread(buffer, count, fd);
+    if (!fd->vfs->usePageCache) {
+        return fd->vfs->fread(buffer, count, fd);
+    }
+
+    int position = fd->vfs->ftell(fd);
+    int read = pagecache_read(fd, buffer, count, position);
+    fd->vfs->fseek(fd, position + read);
+
+    return read;
 }
 
 int kfwrite(char *buffer, int count, FileDesc fd)
 {
-    return rootvfs->fwrite(buffer, count, fd);
+    int offset = fd->vfs->ftell(fd);
+    int written = fd->vfs->fwrite(buffer, count, fd);
+    if (written > 0) {
+        // With VFS_MODE_APPEND the data went at the end, not at 'offset'
+        offset = fd->vfs->ftell(fd) - written;
+        pagecache_write(fd, offset, buffer, written);
+    }
+
+    return written;
+}
+
+int kfreadv(FileDesc fd, struct IOVec *iov, int count)
+{
+    int read = 0;
+    for (int i = 0; i < count; i++) {
+        int result = kfread(iov[i].base, iov[i].length, fd);
+        if (result <= 0)
+            break;
+        read += result;
+        if (result < iov[i].length)
+            break;
+    }
+
+    return read;
+}
+
+/*
+    Writes the segments with fwrite one at a time, for the file systems 
+    that don't support vectored writes
+*/
+static int vfs_fwrite_each(FileDesc fd, struct IOVec *iov, int count)
+{
+    int written = 0;
+    for (int i = 0; i < count; i++) {
+        int result = fd->vfs->fwrite(iov[i].base, iov[i].length, fd);
+        if (result < 0)
+            return written > 0 ? written : result;
+        written += result;
+        if (result < iov[i].length)
+            break;
+    }
+
+    return written;
+}
+
+int kfwritev(FileDesc fd, struct IOVec *iov, int count)
+{
+    int written;
+    if (fd->vfs->fwritev != NULL)
+        written = fd->vfs->fwritev(fd, iov, count);
+    else
+        written = vfs_fwrite_each(fd, iov, count);
+    if (written <= 0)
+        return written;
+
+    // With VFS_MODE_APPEND the data went at the end, not at the cursor
+    int offset = fd->vfs->ftell(fd) - written;
+    int left = written;
+    for (int i = 0; i < count && left > 0; i++) {
+        int length = MIN(iov[i].length, left);
+        pagecache_write(fd, offset, iov[i].base, length);
+        offset += length;
+        left -= length;
+    }
+
+    return written;
+}
+
+int kfseek(FileDesc fd, int offset, int whence)
+{
+    int position;
+    switch (whence) {
+    case VFS_SEEK_SET:
+        position = offset;
+        break;
+    case VFS_SEEK_CUR:
+        position = fd->vfs->ftell(fd) + offset;
+        break;
+    case VFS_SEEK_END:
+        position = fd->filesize + offset;
+        break;
+    default:
+        return -1;
+    }
+    if (position < 0 || position > fd->filesize) {
+        return -1;
+    }
+
+    return fd->vfs->fseek(fd, position);
+}
+
+int kftell(FileDesc fd)
+{
+    return fd->vfs->ftell(fd);
+}
+
+int kpread(FileDesc fd, char *buffer, int count, int offset)
+{
+    if (offset < 0 || offset > fd->filesize) {
+        return -1;
+    }
+    if (fd->vfs->usePageCache) {
+        return pagecache_read(fd, buffer, count, offset);
+    }
+
+    int saved = fd->vfs->ftell(fd);
+    if (kfseek(fd, offset, VFS_SEEK_SET) < 0) {
+        return -1;
+    }
+    int read = fd->vfs->fread(buffer, count, fd);
+    fd->vfs->fseek(fd, saved);
+
+    return read;
+}
+
+int kftruncate(FileDesc fd, int size)
+{
+    int result = fd->vfs->ftruncate(fd, size);
+    if (result == 0) {
+        pagecache_truncate(fd, size);
+    }
+
+    return result;
 }
 
 int kfclose(FileDesc fd)
 {
-    rootvfs->fclose(fd);
+    int result = fd->vfs->fclose(fd);
     kfree(fd);
-    return 0;
+    return result;
+}
+
+int kmkdir(char *path)
+{
+    char *fspath;
+    VFSInterface *vfs = vfs_resolve(path, &fspath);
+    if (vfs == NULL || vfs->makedir == NULL) {
+        return -1;
+    }
+
+    return vfs->makedir(vfs, fspath);
+}
+
+int kunlink(char *path)
+{
+    char *fspath;
+    VFSInterface *vfs = vfs_resolve(path, &fspath);
+    if (vfs == NULL) {
+        return -1;
+    }
+
+    /*
+        The id of a deleted file can be given to a new one, so the cached 
+        pages of the file must go with it
+    */
+    File file;
+    file.vfs = vfs;
+    if (vfs->fopen(vfs, fspath, VFS_MODE_READ, &file) != 0) {
+        return -1;
+    }
+    vfs->fclose(&file);
+    int result = vfs->unlink(vfs, fspath);
+    if (result == 0) {
+        pagecache_invalidate(vfs, file.id);
+    }
+
+    return result;
 }
 
 int kopendir(char *path, Dir *dir)
 {
-    return rootvfs->opendir(path, dir);
+    char *fspath;
+    VFSInterface *vfs = vfs_resolve(path, &fspath);
+    if (vfs == NULL) {
+        return -1;
+    }
+    dir->vfs = vfs;
+
+    return vfs->opendir(vfs, fspath, dir);
 }
 
 int klistdir(Dir *dir, DirEntry *entry)
 {
-    return rootvfs->listdir(dir, entry);
+    return dir->vfs->listdir(dir, entry);
 }
 
 int kclosedir(Dir *dir)
 {
-    return rootvfs->closedir(dir);
+    return dir->vfs->closedir(dir);
 }
\ No newline at end of file
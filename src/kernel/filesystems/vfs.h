@@ -1,19 +1,57 @@
 #ifndef VFS_H
 #define VFS_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include <kernel/lib/time.h>
+#include <kernel/lib/iovec.h>
 
 #define VFS_FS_NAME_LEN 16
 #define VFS_NAME_LEN 255
 
+// How many file systems can be mounted at the same time
+#define VFS_MAX_MOUNTS 8
+#define VFS_MOUNT_PATH_LEN 64
+
+/*
+    Flags describing how a file was opened, these are built by kfopen from 
+    the mode string and passed down to the file system
+*/
+#define VFS_MODE_READ       0x01
+#define VFS_MODE_WRITE      0x02
+#define VFS_MODE_CREATE     0x04
+#define VFS_MODE_TRUNCATE   0x08
+#define VFS_MODE_APPEND     0x10
+
+/*
+    Where the offset passed to kfseek starts from
+*/
+#define VFS_SEEK_SET        0
+#define VFS_SEEK_CUR        1
+#define VFS_SEEK_END        2
+
+struct VFSInterface;
+
 typedef struct File {
     unsigned char name[VFS_NAME_LEN+1];
     int filesize;
+    /*
+        Identifies the file inside its file system: opening the same file 
+        twice gives the same id. Set by the file system in fopen
+    */
+    uint32_t id;
+    // The last page read and the read-ahead window, used by the page cache
+    int lastPage;
+    int readahead;
+    // The file system the file is on
+    struct VFSInterface *vfs;
     void *fs_defined;
 } File;
 
 typedef struct Dir {
     unsigned char name[VFS_NAME_LEN+1];
+    // The file system the directory is on
+    struct VFSInterface *vfs;
     void *fs_defined;
 } Dir;
 
@@ -30,16 +68,33 @@ typedef struct DirEntry {
     void *fs_defined;
 } DirEntry;
 
+/*
+    A mounted file system. Each mount has its own interface, 'fs_defined' 
+    points to the data of that file system instance. Paths passed to the 
+    functions are relative to where the file system is mounted, but still 
+    start with '/'
+*/
 struct VFSInterface {
     unsigned char filesystem[VFS_FS_NAME_LEN];
+    void *fs_defined;
+    /*
+        Set when reads should be served from the page cache. File systems 
+        that already keep their data in memory leave it false
+    */
+    bool usePageCache;
 
-    int (*fopen)(char *path, File *out);
+    int (*fopen)(struct VFSInterface *vfs, char *path, int flags, File *out);
     int (*fread)(char *buffer, int count, File *file);
     int (*fwrite)(char *buffer, int count, File *file);
+    // Optional, writes the segments one after the other like a single fwrite
+    int (*fwritev)(File *file, struct IOVec *iov, int count);
     int (*fclose)(File *file);
-    // int (*fseek)(File *file, int offset, int whence);
-    // int (*makedir)(char *path);
-    int (*opendir)(char *path, Dir *out);
+    int (*ftruncate)(File *file, int size);
+    int (*fseek)(File *file, int position);
+    int (*ftell)(File *file);
+    int (*makedir)(struct VFSInterface *vfs, char *path);
+    int (*unlink)(struct VFSInterface *vfs, char *path);
+    int (*opendir)(struct VFSInterface *vfs, char *path, Dir *out);
     int (*listdir)(Dir *dir, DirEntry *entry);
     int (*closedir)(Dir *dir);
 };
@@ -50,9 +105,26 @@ typedef struct VFSInterface VFSInterface;
 typedef File *FileDesc;
 
 /*
-    Uses the argument virtual file system interface as the VFS for all the 
-    operations on the disk.
-    Returns 0 on success. There are no fail codes
+    Mounts a file system at 'path', which must be an absolute path without 
+    a trailing '/' (except for the root, "/"). Paths starting with 'path' 
+    are handled by that file system, when more mounts match a path the 
+    longest one is used. The directory doesn't need to exist in the parent 
+    file system.
+    Returns 0 on success, -1 if the path is not valid, is already a mount 
+    point or too many file systems are mounted
+*/
+int vfs_mount(char *path, VFSInterface *vfs);
+
+/*
+    Removes the file system mounted at 'path' from the mount table. Files 
+    that are still open on it are not closed.
+    Returns 0 on success, -1 if nothing is mounted at 'path'
+*/
+int vfs_umount(char *path);
+
+/*
+    Mounts the argument virtual file system interface at "/". 
+    Returns 0 on success, -1 if something is already mounted there
 */
 int vfs_setroot(VFSInterface *);
 
@@ -60,12 +132,14 @@ int vfs_setroot(VFSInterface *);
     Opens a file as a byte stream. Path is expected to be an absolute one. 
     Supported modes are:
     - "r" : Opens the file for reading
-    - "w" : UNIMPLEMENTED: Opens the file for writing. If it doesn't exists it 
-            will be created. If a file with the same name already eixsts it 
-            will be overwritten
-    - "r+": UNIMPLEMENTED
-    - "w+": UNIMPLEMENTED
-           
+    - "w" : Opens the file for writing. If it doesn't exists it will be 
+            created. If a file with the same name already exists it will be 
+            overwritten
+    - "a" : Opens the file for appending. If it doesn't exists it will be 
+            created. Every write goes at the end of the file
+    - "r+", "w+", "a+": Same as above, but the file can be both read and 
+            written
+
     Returns a file descriptor, to be used for each operation to refer to
     the opened file, on success. Returns 0 on fail.
 */
@@ -82,19 +156,81 @@ FileDesc kfopen(char *path, char *mode);
 int kfread(char *buffer, int count, FileDesc fd);
 
 /*
-    UNIMPLEMENTED
     Writes 'count' bytes from 'buffer' in the file at the current cursor 
-    position in the file. 
-    Returns the number of written bytes
+    position in the file, moving the cursor forward. The file grows if 
+    the cursor goes past its end. 
+    Returns the number of written bytes, -1 if the file was not opened for 
+    writing
 */
 int kfwrite(char *buffer, int count, FileDesc fd);
 
 /*
-    Closes the file, freeing its resources
-    Returns 0 on success
+    Like kfread, but the bytes are read into the segments one after the 
+    other. Stops at the first segment that is not filled completely.
+    Returns the number of read bytes
+*/
+int kfreadv(FileDesc fd, struct IOVec *iov, int count);
+
+/*
+    Like kfwrite, but writes the segments one after the other. The list is 
+    passed down to the file system, which sends it to the disk without 
+    copying the data when it supports it.
+    Returns the number of written bytes, -1 if the file was not opened for 
+    writing
+*/
+int kfwritev(FileDesc fd, struct IOVec *iov, int count);
+
+/*
+    Moves the cursor of the file to 'offset' bytes from the start of the 
+    file (VFS_SEEK_SET), from the current position (VFS_SEEK_CUR) or from 
+    the end of the file (VFS_SEEK_END). The cursor cannot go before the 
+    start or past the end of the file.
+    Returns the new cursor position, -1 if it would be outside the file
+*/
+int kfseek(FileDesc fd, int offset, int whence);
+
+/*
+    Returns the current cursor position in the file
+*/
+int kftell(FileDesc fd);
+
+/*
+    Reads 'count' bytes from the file starting from 'offset' into 'buffer', 
+    like kfread. The file cursor is not moved.
+    Returns the number of read bytes, -1 if 'offset' is outside the file
+*/
+int kpread(FileDesc fd, char *buffer, int count, int offset);
+
+/*
+    Shrinks the file to 'size' bytes, freeing the space that is not used 
+    anymore. If the cursor was after the new end it is moved to the end.
+    Returns 0 on success, -1 if the file was not opened for writing or if 
+    'size' is bigger than the current size of the file
+*/
+int kftruncate(FileDesc fd, int size);
+
+/*
+    Closes the file, freeing its resources. Any change made to the file is 
+    written to the disk at this point
+    Returns 0 on success, -1 if the changes could not be written
 */
 int kfclose(FileDesc fd);
 
+/*
+    Creates an empty directory at the given absolute path. The parent 
+    directory must exist already.
+    Returns 0 on success, -1 if the path already exists, the parent doesn't 
+    exist or the file system doesn't support creating directories
+*/
+int kmkdir(char *path);
+
+/*
+    Deletes the file at the given absolute path. Directories cannot be 
+    deleted this way.
+    Returns 0 on success, -1 if the file does not exist or is a directory
+*/
+int kunlink(char *path);
+
 /*
     Opens a directory for reading. Returns the directory descriptor in the 
     'dir' argument, which is expected to be non NULL.
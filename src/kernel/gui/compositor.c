@@ -1,12 +1,22 @@
 #include <kernel/devices/framebuffer.h>
 #include <kernel/devices/mouse.h>
+#include <kernel/devices/timer/timer.h>
 #include <kernel/gui/compositor.h>
+#include <kernel/gui/console.h>
 #include <kernel/gui/cursor.h>
 #include <kernel/gui/window.h>
 #include <kernel/lib/graphics/gfx.h>
+#include <kernel/lib/graphics/region.h>
+#include <kernel/lib/graphics/text.h>
 #include <kernel/lib/kassert.h>
 #include <kernel/lib/util.h>
 #include <kernel/memory/kheap.h>
+#include <kernel/memory/mmap.h>
+#include <kernel/memory/shm.h>
+#include <kernel/process.h>
+#include <kernel/ipc/ipc.h>
+#include <kernel/syscall.h>
+#include <klibc/string.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -14,6 +24,7 @@
 
 struct WindowID {
     struct Window *window;
+    struct WindowID *prev;
     struct WindowID *next;
 };
 
@@ -22,6 +33,7 @@ struct WindowID {
     to be always ordered in a descending depth order. 
     This means the first items is the last one that needs to be drawn 
     (the window below all the others) and the last the one above all others. 
+    It is walked backwards to go from the window above all others down
 
 */
 static struct {
@@ -30,6 +42,45 @@ static struct {
     int size;
 } drawlist = {0};
 
+/*
+    Links an unlinked WindowID at the end of the drawlist
+*/
+static void drawlist_append(struct WindowID *w_id)
+{
+    w_id->prev = drawlist.tail;
+    w_id->next = NULL;
+    if (drawlist.tail == NULL)
+        drawlist.head = w_id;
+    else
+        drawlist.tail->next = w_id;
+    drawlist.tail = w_id;
+}
+
+/*
+    Unlinks a WindowID from the drawlist without freeing it
+*/
+static void drawlist_unlink(struct WindowID *w_id)
+{
+    if (w_id->prev != NULL)
+        w_id->prev->next = w_id->next;
+    else
+        drawlist.head = w_id->next;
+    if (w_id->next != NULL)
+        w_id->next->prev = w_id->prev;
+    else
+        drawlist.tail = w_id->prev;
+    w_id->prev = w_id->next = NULL;
+}
+
+static struct WindowID *drawlist_find(struct Window *window)
+{
+    struct WindowID *w_id = drawlist.head;
+    while (w_id != NULL && w_id->window != window)
+        w_id = w_id->next;
+
+    return w_id;
+}
+
 /*
     Adds a window to the drawlist at the end 
     (therefore it will be drawn above all others). 
@@ -42,17 +93,8 @@ static int drawlist_add(struct Window *window)
         return -1;
     
     w_id->window = window;
-    w_id->next = NULL;
-
-    if (drawlist.tail == NULL) {
-        drawlist.head = w_id;
-        drawlist.tail = w_id;
-        drawlist.size = 1;
-    } else {
-        drawlist.tail->next = w_id;
-        drawlist.tail = w_id;
-        drawlist.size++;
-    }
+    drawlist_append(w_id);
+    drawlist.size++;
 
     return 0;
 }
@@ -62,24 +104,16 @@ static int drawlist_add(struct Window *window)
     Returns 0 on success, -1 if the window could not be found
 */
 static int drawlist_focus(struct Window *window) {
-    if (drawlist.tail->window == window)
-        return 0;
-    
-    struct WindowID *w_id = drawlist.head;
-    while (w_id != NULL) {
-        if (w_id->next != NULL && w_id->next->window == window) {
-            struct WindowID *curr = w_id;
-            struct WindowID *wind = w_id->next;
-            curr->next = wind->next;
-            wind->next = NULL;
-            drawlist.tail->next = wind;
-            drawlist.tail = wind;
-            return 0;
-        }
-        w_id = w_id->next;
+    struct WindowID *w_id = drawlist_find(window);
+    if (w_id == NULL)
+        return -1;
+
+    if (w_id != drawlist.tail) {
+        drawlist_unlink(w_id);
+        drawlist_append(w_id);
     }
 
-    return -1;
+    return 0;
 }
 
 /*
@@ -88,31 +122,15 @@ static int drawlist_focus(struct Window *window) {
     Returns 0 on success, -1 if the window could not be found
 */
 static int drawlist_remove(struct Window *window) {
-    if (drawlist.head == drawlist.tail && drawlist.head->window == window) {
-        drawlist.head = drawlist.tail = NULL;
-        drawlist.size = 0;
-        
-        return 0;
-    }
+    struct WindowID *w_id = drawlist_find(window);
+    if (w_id == NULL)
+        return -1;
 
-    struct WindowID *w_id = drawlist.head;
-    while (w_id != NULL) {
-        if (w_id->next != NULL && w_id->next->window == window) {
-            struct WindowID *curr = w_id;
-            struct WindowID *to_remove = w_id->next;
-            curr->next = to_remove->next;
-            
-            if (drawlist.tail == to_remove)
-                drawlist.tail = curr;
-            kfree(to_remove);
-            drawlist.size--;
-            
-            return 0;
-        }
-        w_id = w_id->next;
-    }
+    drawlist_unlink(w_id);
+    kfree(w_id);
+    drawlist.size--;
 
-    return -1;
+    return 0;
 }
 
 int register_window(struct Window *window)
@@ -130,11 +148,345 @@ int focus_window(struct Window *window)
     return drawlist_focus(window);
 }
 
+/*
+    The windows created by the clients of the compositor, with the pid of 
+    the process that created each one
+*/
+static struct {
+    struct Window *window;
+    uint32_t owner;
+} client_windows[COMPOSITOR_MAX_WINDOWS];
+
+static struct Window *background;
+
+/*
+    Areas of the screen to draw again that don't belong to a window in the 
+    drawlist anymore, or that changed because the windows changed order
+*/
+static struct Region pending_damage;
+
+static void damage_screen(struct Rect rect)
+{
+    region_add(&pending_damage, &rect);
+}
+
+/*
+    Returns the window number 'id' if it belongs to 'client', NULL otherwise
+*/
+static struct Window *client_window(uint32_t client, uint32_t id)
+{
+    if (id >= COMPOSITOR_MAX_WINDOWS || client_windows[id].window == NULL || 
+            client_windows[id].owner != client)
+        return NULL;
+
+    return client_windows[id].window;
+}
+
+/*
+    Writes in 'name' the name of the shared memory region of a new window, 
+    a different one each time
+*/
+static void surface_name(char *name)
+{
+    static uint32_t created = 0;
+    char digits[10];
+    int count = 0;
+    uint32_t n = created++;
+    do {
+        digits[count++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+
+    strcpy(name, "window");
+    int length = strlen(name);
+    while (count > 0)
+        name[length++] = digits[--count];
+    name[length] = '\0';
+}
+
+/*
+    Creates a window whose content is shared with the client and mapped in 
+    its address space, the address is written in 'surface'
+*/
+static int create_client_window(uint32_t client, int width, int height, uint32_t *surface)
+{
+    struct FrameBuffer *screen = get_screen_framebuffer();
+    if (width <= 0 || height <= 0 || width > screen->width || height > screen->height)
+        return -1;
+    Process *proc = process_find(client);
+    if (proc == NULL)
+        return -1;
+
+    for (int i = 0; i < COMPOSITOR_MAX_WINDOWS; i++) {
+        if (client_windows[i].window != NULL)
+            continue;
+
+        char name[SHM_NAME_LEN + 1];
+        surface_name(name);
+        // Each new window is a bit lower and to the right of the previous one
+        struct Window *window = window_create_shared(
+            "Window", 32 + 24 * i, 32 + 24 * i, width, height, name
+        );
+        if (window == NULL)
+            return -1;
+        vaddr_t addr = kshmmap(proc, name, 0, MMAP_PROT_READ | MMAP_PROT_WRITE);
+        if (addr == 0) {
+            window_free(window);
+            return -1;
+        }
+        if (register_window(window) != 0) {
+            kmunmap(proc, addr);
+            window_free(window);
+            return -1;
+        }
+        *surface = addr;
+        client_windows[i].window = window;
+        client_windows[i].owner = client;
+        return i;
+    }
+
+    return -1;
+}
+
+static int destroy_client_window(uint32_t client, uint32_t id)
+{
+    struct Window *window = client_window(client, id);
+    if (window == NULL)
+        return -1;
+
+    // What was below the window has to be drawn again
+    damage_screen(window_frame(window, window->drawnX, window->drawnY));
+    unregister_window(window);
+    window_free(window);
+    client_windows[id].window = NULL;
+
+    return 0;
+}
+
+/*
+    Returns true if the window can be moved to x, y. It can go off the 
+    screen, but only so far that the sums of its coordinates and sizes 
+    can't overflow
+*/
+static bool move_in_range(struct Window *window, uint32_t x, uint32_t y)
+{
+    struct FrameBuffer *screen = get_screen_framebuffer();
+    struct Rect frame = window_frame(window, 0, 0);
+    const int max_x = screen->width + frame.width;
+    const int max_y = screen->height + frame.height;
+
+    return (int32_t) x >= -max_x && (int32_t) x <= max_x && 
+        (int32_t) y >= -max_y && (int32_t) y <= max_y;
+}
+
+/*
+    Executes the request of a client, writing the reply in the same message
+*/
+static void handle_request(uint32_t client, struct IPCMessage *msg)
+{
+    uint32_t *args = msg->words;
+    struct Window *window;
+    int result = -1;
+
+    switch (args[0]) {
+    case COMPOSITOR_PING:
+        result = 0;
+        break;
+    case COMPOSITOR_CREATE_WINDOW:
+        // The address of the content is the second word of the reply
+        result = create_client_window(client, args[1], args[2], &args[1]);
+        break;
+    case COMPOSITOR_DESTROY_WINDOW:
+        result = destroy_client_window(client, args[1]);
+        break;
+    case COMPOSITOR_MOVE_WINDOW:
+        if ((window = client_window(client, args[1])) != NULL && 
+                move_in_range(window, args[2], args[3])) {
+            window->x = (int32_t) args[2];
+            window->y = (int32_t) args[3];
+            window->flags |= WINDOW_MOVED;
+            result = 0;
+        }
+        break;
+    case COMPOSITOR_FOCUS_WINDOW:
+        if ((window = client_window(client, args[1])) != NULL) {
+            result = focus_window(window);
+            damage_screen(window_frame(window, window->drawnX, window->drawnY));
+        }
+        break;
+    case COMPOSITOR_FILL_WINDOW:
+        if ((window = client_window(client, args[1])) != NULL) {
+            fill_rect(window->fb, 0, 0, window->fb->width, window->fb->height, args[2]);
+            window_damage(window, 0, 0, window->fb->width, window->fb->height);
+            result = 0;
+        }
+        break;
+    case COMPOSITOR_SET_OPACITY:
+        if ((window = client_window(client, args[1])) != NULL && args[2] <= WINDOW_OPAQUE) {
+            window->opacity = args[2];
+            if (args[3] != 0)
+                window->flags |= WINDOW_ALPHA;
+            else
+                window->flags &= ~WINDOW_ALPHA;
+            // What is below the window may show through it or be covered now
+            damage_screen(window_frame(window, window->drawnX, window->drawnY));
+            result = 0;
+        }
+        break;
+    case COMPOSITOR_COMMIT_WINDOW:
+        if ((window = client_window(client, args[1])) != NULL) {
+            window_damage(
+                window, 
+                args[2] >> 16, args[2] & 0xffff, 
+                args[3] >> 16, args[3] & 0xffff
+            );
+            result = 0;
+        }
+        break;
+    }
+
+    msg->words[0] = result;
+}
+
+/*
+    Destroys the windows of the clients that exited. Pids are never used 
+    again, so a window whose owner can't be found belongs to nobody
+*/
+static void destroy_orphan_windows(void)
+{
+    for (int i = 0; i < COMPOSITOR_MAX_WINDOWS; i++) {
+        if (client_windows[i].window != NULL && process_find(client_windows[i].owner) == NULL)
+            destroy_client_window(client_windows[i].owner, i);
+    }
+}
+
+/*
+    Serves all the requests that are waiting, without waiting for new ones. 
+    Each reply switches straight to the client that made the call
+*/
+static void serve_requests(int endpoint)
+{
+    struct IPCMessage msg;
+    uint32_t client;
+
+    destroy_orphan_windows();
+
+    msg.words[0] = IPC_NONBLOCK;
+    while (ipc_syscall_raw(SYS_IPC_RECEIVE, endpoint, &msg, &client) == 0) {
+        handle_request(client, &msg);
+        ipc_syscall_raw(SYS_IPC_REPLY, 0, &msg, NULL);
+        msg.words[0] = IPC_NONBLOCK;
+    }
+}
+
+/*
+    Collects in 'damage' the areas of the screen that changed since the 
+    last frame: where moved windows were and are now, the damaged parts of 
+    the updated windows and the pending damage. The windows are marked as 
+    drawn
+*/
+static void collect_damage(struct Region *damage)
+{
+    struct FrameBuffer *screen = get_screen_framebuffer();
+    struct Rect bounds = {0, 0, screen->width, screen->height};
+
+    *damage = pending_damage;
+    region_clear(&pending_damage);
+    for (struct WindowID *id = drawlist.head; id != NULL; id = id->next) {
+        struct Window *window = id->window;
+        struct Rect frame = window_frame(window, window->x, window->y);
+        if (window->flags & WINDOW_MOVED) {
+            struct Rect old = window_frame(window, window->drawnX, window->drawnY);
+            region_add(damage, &old);
+            region_add(damage, &frame);
+        } else if (window->flags & WINDOW_UPDATED) {
+            if (region_is_empty(&window->damage)) {
+                region_add(damage, &frame);
+            } else {
+                // The content starts right below the bar
+                region_translate(
+                    &window->damage, 
+                    window->x, window->y + WINDOW_BAR_HEIGHT + 1
+                );
+                region_union(damage, &window->damage);
+            }
+        }
+        window->drawnX = window->x;
+        window->drawnY = window->y;
+        window->flags &= ~(WINDOW_UPDATED | WINDOW_MOVED);
+        region_clear(&window->damage);
+    }
+    region_clip(damage, &bounds);
+}
+
+/*
+    Decides which part of the damage each window draws. Going from the 
+    window above all others down, each one gets the part of its frame that 
+    is damaged and not covered by the windows above it, so every damaged 
+    pixel is drawn only by the window that is visible there. Translucent 
+    content covers nothing: the windows below draw there too and the 
+    translucent window is mixed over them
+*/
+static void compute_visible(struct Region *damage)
+{
+    struct Region uncovered = *damage;
+
+    for (struct WindowID *id = drawlist.tail; id != NULL; id = id->prev) {
+        struct Window *window = id->window;
+        struct Rect frame = window_frame(window, window->x, window->y);
+        window->visible = uncovered;
+        region_clip(&window->visible, &frame);
+        struct Rect opaque = window_opaque_frame(window, window->x, window->y);
+        region_subtract(&uncovered, &opaque);
+    }
+}
+
+/*
+    Draws again the damaged areas of the screen, each window only where 
+    it is visible. The windows are still 
+    drawn from the bottom up: if a region ran out of rectangles and covers 
+    more than it should the windows above draw over the extra area
+*/
+static void repaint(struct Region *damage)
+{
+    struct FrameBuffer *screen = get_screen_framebuffer();
+
+    compute_visible(damage);
+    for (struct WindowID *id = drawlist.head; id != NULL; id = id->next) {
+        struct Window *window = id->window;
+        for (int i = 0; i < window->visible.count; i++)
+            draw_window_area(screen, window, &window->visible.rects[i]);
+    }
+}
+
+/*
+    Sleeps with SYS_SLEEP until the timer reaches 'tick'. 
+    Returns the tick count when the compositor wakes up
+*/
+static uint32_t sleep_until(uint32_t tick)
+{
+    uint32_t now;
+    asm volatile(
+        "int $0x80" 
+        : "=a"(now) 
+        : "a"(SYS_SLEEP), "b"(tick) 
+        : "memory"
+    );
+
+    return now;
+}
+
 static void set_background(struct Window *window)
 {
     struct WindowID *id = kmalloc(sizeof(struct WindowID));
-    id->next = drawlist.head;
+    kassert(id != NULL);
     id->window = window;
+    id->prev = NULL;
+    id->next = drawlist.head;
+    if (drawlist.head != NULL)
+        drawlist.head->prev = id;
+    else
+        drawlist.tail = id;
     drawlist.head = id;
     drawlist.size++;
 }
@@ -142,7 +494,7 @@ static void set_background(struct Window *window)
 void __compositor_main(void)
 {
     struct FrameBuffer *screen = get_screen_framebuffer();
-    struct Window *background = window_create(
+    background = window_create(
         "Background", 
         0, -WINDOW_BAR_HEIGHT, 
         screen->width, screen->height
@@ -152,77 +504,58 @@ void __compositor_main(void)
     background->flags |= WINDOW_UPDATED;
     set_background(background);
     
+    // From now on the kernel output is shown in a window
+    const int console_width = CONSOLE_COLUMNS * text_glyph_width();
+    const int console_height = CONSOLE_ROWS * text_glyph_height();
+    struct Window *console = window_create(
+        "Console", 
+        MAX(0, screen->width - console_width - 32), 48, 
+        console_width, console_height
+    );
+    kassert(register_window(console) == 0);
+    console_attach(console);
+
     struct MouseStatus previous = (struct MouseStatus) {0};
 
+    struct IPCMessage msg;
+    int endpoint = ipc_syscall_raw(SYS_IPC_CREATE, (uint32_t) COMPOSITOR_ENDPOINT, &msg, NULL);
+    kassert(endpoint >= 0);
+
+    /*
+        A frame is drawn every 'frame_ticks' ticks at most, with all the 
+        changes since the previous one, and in between the compositor 
+        sleeps. Requests that come in the meantime wait for the next frame
+    */
+    const uint32_t frame_ticks = MAX(
+        1, (timer_frequency() + COMPOSITOR_FPS - 1) / COMPOSITOR_FPS
+    );
+    uint32_t next_frame = timer_get_ticks();
+    struct Region damage;
     while (true) {
-        struct {
-            int tlx, tly;
-            int brx, bry;
-        } update_area;
-        update_area.tlx = screen->width;
-        update_area.tly = screen->height;
-        update_area.brx = 0;
-        update_area.bry = 0;
+        serve_requests(endpoint);
+        console_flush();
+
+        collect_damage(&damage);
+        repaint(&damage);
 
         /*
-            Here we try to decide if we should redraw the whole screen 
-            or we can just update parts of it. If a window was moved we 
-            need to redraw everything, otherwise we might be able to avoid it. 
-            I expect that there will be not many windows open at the same time 
-            (less than 20) therefore looping twice is not bad
+            The cursor is above everything else: it is taken away while the 
+            screen is updated and drawn again after. When only the mouse 
+            moved this is all that happens
         */
-        struct WindowID *id = drawlist.head;
-        bool full_update = false;
-        bool needs_redraw = false;
-        while (id) {
-            if (id->window->flags & WINDOW_MOVED) {
-                full_update = true;
-                needs_redraw = true;
-            }
-            
-            if (needs_redraw || id->window->flags & WINDOW_UPDATED) {
-                needs_redraw = true;
-                update_area.tlx = MIN(update_area.tlx, id->window->x);
-                update_area.tly = MIN(update_area.tly, id->window->y);
-                update_area.brx = MAX(
-                    update_area.brx, 
-                    id->window->x + id->window->fb->width
-                );
-                update_area.bry = MAX(
-                    update_area.bry, 
-                    id->window->y + id->window->fb->height + WINDOW_BAR_HEIGHT
-                );
-            }
-            
-            id = id->next;
-        }
-        
-        if (needs_redraw) {
-            id = drawlist.head;
-            while (id) {
-                const int flags = id->window->flags;
-                if (full_update || flags & (WINDOW_UPDATED | WINDOW_MOVED)) {
-                    draw_window(screen, id->window);
-                    id->window->flags = flags & ~(WINDOW_UPDATED | WINDOW_MOVED);
-                }
-
-                id = id->next;
-            }
-        }
-        
-        screen_update(
-            update_area.tlx, update_area.tly, 
-            update_area.brx - update_area.tlx, 
-            update_area.bry - update_area.tly);
-        
         struct MouseStatus mouse = mouse_status();
-        if (mouse.x != previous.x || mouse.y != previous.y) {
-            screen_update(
-                previous.x, previous.y, 
-                cursor_width(), cursor_height()
-            );
-            draw_cursor(get_main_framebuffer(), mouse.x, mouse.y);
+        bool moved = mouse.x != previous.x || mouse.y != previous.y;
+        if (moved || !region_is_empty(&damage)) {
+            cursor_hide();
+            screen_present(&damage);
+            cursor_show(get_main_framebuffer(), mouse.x, mouse.y);
             previous = mouse;
         }
+
+        next_frame += frame_ticks;
+        uint32_t now = sleep_until(next_frame);
+        // After a late frame the next ones are not hurried to catch up
+        if ((int32_t) (now - next_frame) > 0)
+            next_frame = now;
     }
-}
\ No newline at end of file
+}
@@ -3,6 +3,68 @@
 
 #include <kernel/gui/window.h>
 
+// The name of the IPC endpoint of the compositor, see SYS_IPC_LOOKUP
+#define COMPOSITOR_ENDPOINT     "compositor"
+
+// How many windows the clients of the compositor can have at the same time
+#define COMPOSITOR_MAX_WINDOWS  32
+
+// The most frames per second the compositor draws
+#define COMPOSITOR_FPS          60
+
+/*
+    Puts two 16 bits numbers in a single word of a message, 'high' in the 
+    upper half
+*/
+#define COMPOSITOR_PACK(high, low) \
+    (((uint32_t) (high) << 16) | ((uint32_t) (low) & 0xffff))
+
+/*
+    The requests the compositor serves with SYS_IPC_CALL. The first word of 
+    the message is the request, the others its arguments. The first word of 
+    the reply is the result, -1 if the request failed. Windows can only be 
+    used by the process that created them
+*/
+enum {
+    // Does nothing, replies 0
+    COMPOSITOR_PING = 1, 
+    /*
+        (width, height): creates a window, replies its number and the 
+        address where its content is mapped in the caller: the client draws 
+        there directly, one row of 'width' pixels after the other, and 
+        tells which parts changed with COMPOSITOR_COMMIT_WINDOW
+    */
+    COMPOSITOR_CREATE_WINDOW, 
+    /*
+        (window): destroys a window. The content stays mapped in the client 
+        until it unmaps it with SYS_MUNMAP or exits, then its memory is 
+        freed. The windows of a client that exits are destroyed at the 
+        next frame, so their memory is freed too
+    */
+    COMPOSITOR_DESTROY_WINDOW, 
+    /*
+        (window, x, y): moves a window. It can be partly or completely off 
+        the screen, by at most the size of the screen and its own
+    */
+    COMPOSITOR_MOVE_WINDOW, 
+    // (window): moves a window above all the others
+    COMPOSITOR_FOCUS_WINDOW, 
+    // (window, color): fills the content of a window with a color
+    COMPOSITOR_FILL_WINDOW, 
+    /*
+        (window, opacity, alpha): sets how much the content of a window 
+        covers what is below it, from 0 to WINDOW_OPAQUE, and if alpha is 
+        not 0 the highest byte of each color filled is its own opacity
+    */
+    COMPOSITOR_SET_OPACITY, 
+    /*
+        (window, COMPOSITOR_PACK(x, y), COMPOSITOR_PACK(width, height)): 
+        the client changed that area of the content, it is drawn again on 
+        the next frame
+    */
+    COMPOSITOR_COMMIT_WINDOW
+};
+
 /*
     Adds the window to the list of windows that will be drawn each frame 
     by the window
@@ -26,7 +88,8 @@ int focus_window(struct Window *window);
     The compositor is a normal application, except its code is written in the 
     kernel. At startup a process is started with this function as its entry 
     point. You should not call this function directly but only by creating a 
-    new process
+    new process. Other programs talk to it with IPC calls on the 
+    COMPOSITOR_ENDPOINT endpoint, which are served at the start of each frame
 */
 void __compositor_main(void);
 
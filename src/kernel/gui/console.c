@@ -0,0 +1,188 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/arch/i386/x86.h>
+#include <kernel/devices/framebuffer.h>
+#include <kernel/devices/tty/tty.h>
+#include <kernel/gui/console.h>
+#include <kernel/gui/window.h>
+#include <kernel/lib/graphics/gfx.h>
+#include <kernel/lib/graphics/region.h>
+#include <kernel/lib/graphics/text.h>
+#include <kernel/lib/util.h>
+#include <klibc/string.h>
+
+
+#define CONSOLE_FOREGROUND  0x00c0c0c0
+#define CONSOLE_BACKGROUND  COLOR_BLACK
+
+static struct {
+    bool active;
+    struct Window *window;
+    /*
+        The lines of characters are a ring: the line at the top of the
+        console is 'top', so scrolling only moves 'top' and clears one line
+    */
+    char cells[CONSOLE_ROWS][CONSOLE_COLUMNS];
+    int top;
+    // Where the next character goes, the row counts from the top line
+    int row, column;
+    // For each row the columns [dirtyFrom, dirtyTo) have to be drawn again
+    int dirtyFrom[CONSOLE_ROWS];
+    int dirtyTo[CONSOLE_ROWS];
+} console;
+
+static char *console_line(int row)
+{
+    return console.cells[(console.top + row) % CONSOLE_ROWS];
+}
+
+static void console_dirty(int row, int from, int to)
+{
+    console.dirtyFrom[row] = MIN(console.dirtyFrom[row], from);
+    console.dirtyTo[row] = MAX(console.dirtyTo[row], to);
+}
+
+static void console_dirty_all(void)
+{
+    for (int row = 0; row < CONSOLE_ROWS; row++)
+        console_dirty(row, 0, CONSOLE_COLUMNS);
+}
+
+static void console_newline(void)
+{
+    console.column = 0;
+    if (++console.row < CONSOLE_ROWS)
+        return;
+
+    /*
+        The line that goes out at the top becomes the new bottom line. All
+        the rows are drawn again, but only at the next draw, so many lines
+        written together cost a single redraw
+    */
+    console.row = CONSOLE_ROWS - 1;
+    console.top = (console.top + 1) % CONSOLE_ROWS;
+    memset(console_line(console.row), ' ', CONSOLE_COLUMNS);
+    console_dirty_all();
+}
+
+static void console_putchar(char c)
+{
+    char *line = console_line(console.row);
+    switch (c) {
+    case '\b':
+        if (console.column > 0)
+            console.column--;
+        line[console.column] = ' ';
+        console_dirty(console.row, console.column, console.column + 1);
+        return;
+    case '\n':
+        console_newline();
+        return;
+    case '\t':
+        for (int i = 0; i < CONSOLE_TAB_SIZE; i++)
+            console_putchar(' ');
+        return;
+    }
+
+    line[console.column] = c;
+    console_dirty(console.row, console.column, console.column + 1);
+    if (++console.column == CONSOLE_COLUMNS)
+        console_newline();
+}
+
+/*
+    Draws the characters that changed on 'fb', each changed run of a row
+    with a single call, and adds the areas drawn to 'drawn'.
+    The console can be written while this runs: each run is taken and 
+    marked clean with the interrupts disabled before it is drawn, so what 
+    is written in the meantime is drawn the next time
+*/
+static void console_draw(struct FrameBuffer *fb, struct Region *drawn)
+{
+    const int glyph_width = text_glyph_width();
+    const int glyph_height = text_glyph_height();
+    Color old_color = get_color();
+    set_color(CONSOLE_FOREGROUND);
+
+    for (int row = 0; row < CONSOLE_ROWS; row++) {
+        char text[CONSOLE_COLUMNS];
+        uint32_t flags = irq_save();
+        const int from = console.dirtyFrom[row];
+        const int to = console.dirtyTo[row];
+        if (from < to) {
+            memcpy(text, console_line(row) + from, to - from);
+            console.dirtyFrom[row] = CONSOLE_COLUMNS;
+            console.dirtyTo[row] = 0;
+        }
+        irq_restore(flags);
+        if (from >= to)
+            continue;
+
+        struct Rect area = {
+            from * glyph_width, row * glyph_height,
+            (to - from) * glyph_width, glyph_height
+        };
+        fill_rect(fb, area.x, area.y, area.width, area.height, CONSOLE_BACKGROUND);
+        draw_chars(fb, area.x, area.y, text, to - from);
+        region_add(drawn, &area);
+    }
+    set_color(old_color);
+}
+
+void console_init(void)
+{
+    memset(console.cells, ' ', sizeof(console.cells));
+    console.top = 0;
+    console.row = 0;
+    console.column = 0;
+    console.window = NULL;
+    console_dirty_all();
+    console.active = true;
+}
+
+void console_write(const char *data, size_t size)
+{
+    if (!console.active) {
+        terminal_write(data, size);
+        return;
+    }
+
+    // The compositor may be drawing the console when this process is stopped
+    uint32_t flags = irq_save();
+    for (size_t i = 0; i < size; i++)
+        console_putchar(data[i]);
+    irq_restore(flags);
+
+    if (console.window == NULL) {
+        struct Region drawn;
+        region_clear(&drawn);
+        console_draw(get_screen_framebuffer(), &drawn);
+        for (int i = 0; i < drawn.count; i++) {
+            struct Rect *r = &drawn.rects[i];
+            screen_update(r->x, r->y, r->width, r->height);
+        }
+    }
+}
+
+void console_attach(struct Window *window)
+{
+    uint32_t flags = irq_save();
+    console.window = window;
+    console_dirty_all();
+    irq_restore(flags);
+}
+
+void console_flush(void)
+{
+    if (!console.active || console.window == NULL)
+        return;
+
+    struct Region drawn;
+    region_clear(&drawn);
+    console_draw(console.window->fb, &drawn);
+    for (int i = 0; i < drawn.count; i++) {
+        struct Rect *r = &drawn.rects[i];
+        window_damage(console.window, r->x, r->y, r->width, r->height);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stddef.h>
+#include <kernel/gui/window.h>
+
+// The size of the console, in characters
+#define CONSOLE_COLUMNS     80
+#define CONSOLE_ROWS        30
+
+#define CONSOLE_TAB_SIZE    4
+
+/*
+    Starts showing the kernel output on the framebuffer, in the top left
+    corner of the screen, instead of in VGA text mode which can't be seen
+    once the screen is in graphics mode. The framebuffer must be set up
+*/
+void console_init(void);
+
+/*
+    Writes characters on the console. This only changes the characters
+    kept by the console and remembers which ones changed: until the console
+    is attached to a window they are drawn on the screen at the end of the
+    call, after that only by console_flush.
+    Before console_init this writes in VGA text mode
+*/
+void console_write(const char *data, size_t size);
+
+/*
+    Makes the console draw its content in the window, whose content must be
+    CONSOLE_COLUMNS by CONSOLE_ROWS characters big, instead of on the screen
+*/
+void console_attach(struct Window *window);
+
+/*
+    Draws the characters that changed since the last call on the window the
+    console is attached to, and marks them damaged in the window
+*/
+void console_flush(void);
+
+#endif
@@ -1,6 +1,7 @@
 #include <kernel/devices/framebuffer.h>
 #include <kernel/gui/cursor.h>
 #include <kernel/lib/graphics/gfx.h>
+#include <kernel/lib/kassert.h>
 #include <kernel/lib/util.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -17,22 +18,111 @@ static unsigned char cursor_data[] = {
     #include <kernel/gui/cursor_data.h>
 };
 
+/*
+    The cursor image ready to be drawn: each row has the list of runs of 
+    pixels that are not transparent, so that drawing only copies those 
+    runs and never looks at the transparent pixels
+*/
+#define CURSOR_MAX_RUNS     (CURSOR_MAX_WIDTH / 2 + 1)
+
+struct CursorRun {
+    int start, length;
+};
 
-void draw_cursor(struct FrameBuffer *fb, int x, int y)
+static struct {
+    bool ready;
+    int width, height;
+    Color pixels[CURSOR_MAX_HEIGHT][CURSOR_MAX_WIDTH];
+    struct CursorRun runs[CURSOR_MAX_HEIGHT][CURSOR_MAX_RUNS];
+    int runCount[CURSOR_MAX_HEIGHT];
+} sprite;
+
+/*
+    The pixels below the cursor while it is shown, and where they are
+*/
+static struct {
+    bool shown;
+    struct FrameBuffer fb;
+    int x, y, width, height;
+    uint32_t pixels[CURSOR_MAX_HEIGHT * CURSOR_MAX_WIDTH];
+} under;
+
+static void cursor_prepare(void)
 {
-    const int width = cursor_data[0];
-    const int height = cursor_data[1];
+    sprite.width = cursor_data[0];
+    sprite.height = cursor_data[1];
+    kassert(sprite.width <= CURSOR_MAX_WIDTH && sprite.height <= CURSOR_MAX_HEIGHT);
 
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            const unsigned dataoffset = 2 + (i * width + j);
-            if (cursor_data[dataoffset] == 0) {
-                put_pixel(fb, x + j, y + i, COLOR_BLACK);
-            } else if (cursor_data[dataoffset] == 1) {
-                put_pixel(fb, x + j, y + i, COLOR_WHITE);
+    for (int i = 0; i < sprite.height; i++) {
+        sprite.runCount[i] = 0;
+        struct CursorRun *run = NULL;
+        for (int j = 0; j < sprite.width; j++) {
+            const unsigned char value = cursor_data[2 + i * sprite.width + j];
+            if (value != 0 && value != 1) {
+                sprite.pixels[i][j] = 0;
+                run = NULL;
+                continue;
+            }
+            sprite.pixels[i][j] = value == 0 ? COLOR_BLACK : COLOR_WHITE;
+            if (run == NULL) {
+                run = &sprite.runs[i][sprite.runCount[i]++];
+                run->start = j;
+                run->length = 0;
             }
+            run->length++;
         }
     }
+    sprite.ready = true;
+}
+
+void cursor_show(struct FrameBuffer *fb, int x, int y)
+{
+    kassert(!under.shown);
+    if (!sprite.ready)
+        cursor_prepare();
+
+    int left = x, top = y, width = sprite.width, height = sprite.height;
+    if (!fb_clip(fb, &left, &top, &width, &height))
+        return;
+
+    under.shown = true;
+    under.fb = *fb;
+    under.x = left;
+    under.y = top;
+    under.width = width;
+    under.height = height;
+
+    char *row = fb->addr + fb_offset(fb, left, top);
+    for (int i = 0; i < height; i++) {
+        uint32_t *pixels = (uint32_t *) row;
+        fb_copy_pixels(&under.pixels[i * width], pixels, width);
+
+        // The runs are cut to the part of the cursor inside the framebuffer
+        const int sy = top - y + i;
+        for (int r = 0; r < sprite.runCount[sy]; r++) {
+            const struct CursorRun *run = &sprite.runs[sy][r];
+            const int from = MAX(run->start, left - x);
+            const int to = MIN(run->start + run->length, left - x + width);
+            if (from >= to)
+                continue;
+            uint32_t *dest = pixels + (x + from - left);
+            fb_copy_pixels(dest, &sprite.pixels[sy][from], to - from);
+        }
+        row += fb->pitch;
+    }
+}
+
+void cursor_hide(void)
+{
+    if (!under.shown)
+        return;
+
+    char *row = under.fb.addr + fb_offset(&under.fb, under.x, under.y);
+    for (int i = 0; i < under.height; i++) {
+        fb_copy_pixels((uint32_t *) row, &under.pixels[i * under.width], under.width);
+        row += under.fb.pitch;
+    }
+    under.shown = false;
 }
 
 int cursor_width(void)
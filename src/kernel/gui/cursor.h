@@ -3,6 +3,10 @@
 
 #include <kernel/devices/framebuffer.h>
 
+// The biggest cursor image that can be used
+#define CURSOR_MAX_WIDTH    32
+#define CURSOR_MAX_HEIGHT   32
+
 /*
     Returns the width of the cursor image
 */
@@ -14,8 +18,18 @@ int cursor_width(void);
 int cursor_height(void);
 
 /*
-    Draws a mouse cursor on the framebuffer at a given position
+    Draws the mouse cursor on the framebuffer at a given position, saving 
+    the pixels it covers first. The cursor is like a plane above what is on 
+    the framebuffer: showing, hiding and moving it only touches the pixels 
+    below it, nothing else has to be drawn again. Only one cursor can be 
+    shown at a time
+*/
+void cursor_show(struct FrameBuffer *framebuffer, int x, int y);
+
+/*
+    Puts back the pixels the cursor covers, if it is shown. To be called 
+    before anything below the cursor is drawn, followed by cursor_show
 */
-void draw_cursor(struct FrameBuffer *framebuffer, int x, int y);
+void cursor_hide(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -4,10 +4,15 @@
 #include <kernel/lib/graphics/text.h>
 #include <kernel/lib/kassert.h>
 #include <kernel/memory/kheap.h>
+#include <kernel/memory/mmap.h>
+#include <kernel/process.h>
 #include <klibc/string.h>
 
 
-struct Window *window_create(char *title, int x, int y, int width, int height)
+/*
+    Allocates a window whose content is 'fb'
+*/
+static struct Window *window_alloc(char *title, int x, int y, struct FrameBuffer *fb)
 {
     // TODO: Actually return NULL instead of panicking on "not enough memory"
     struct Window *w = kmalloc(sizeof(struct Window));
@@ -19,45 +24,136 @@ struct Window *window_create(char *title, int x, int y, int width, int height)
 
     w->x = x;
     w->y = y;
-    w->fb = fb_alloc(width, height);
+    w->fb = fb;
+    w->surface = 0;
     w->flags = WINDOW_UPDATED | WINDOW_MOVED;
+    w->opacity = WINDOW_OPAQUE;
+    w->drawnX = x;
+    w->drawnY = y;
+    region_clear(&w->damage);
+    region_clear(&w->visible);
     kassert(w->fb != NULL);
 
     return w;
 }
 
+struct Window *window_create(char *title, int x, int y, int width, int height)
+{
+    return window_alloc(title, x, y, fb_alloc(width, height));
+}
+
+struct Window *window_create_shared(char *title, int x, int y, int width, int height, char *name)
+{
+    const int bpp = get_screen_framebuffer()->bytesPerPixel;
+    Process *proc = get_running_process();
+    vaddr_t surface = kshmcreate(
+        proc, name, width * height * bpp, MMAP_PROT_READ | MMAP_PROT_WRITE
+    );
+    if (surface == 0)
+        return NULL;
+    struct FrameBuffer *fb = fb_wrap((void *) surface, width, height);
+    if (fb == NULL) {
+        kmunmap(proc, surface);
+        return NULL;
+    }
+
+    struct Window *w = window_alloc(title, x, y, fb);
+    w->surface = surface;
+
+    return w;
+}
+
 void window_free(struct Window *window)
 {
     kfree(window->title);
-    fb_free(window->fb);
+    if (window->surface != 0) {
+        kfree(window->fb);
+        kmunmap(get_running_process(), window->surface);
+    } else {
+        fb_free(window->fb);
+    }
     kfree(window);
 }
 
-void draw_window(struct FrameBuffer *fb, struct Window *window)
+struct Rect window_frame(struct Window *window, int x, int y)
+{
+    return (struct Rect) {
+        x, y, 
+        window->fb->width, WINDOW_BAR_HEIGHT + 1 + window->fb->height
+    };
+}
+
+struct Rect window_opaque_frame(struct Window *window, int x, int y)
+{
+    struct Rect frame = window_frame(window, x, y);
+    if (window->opacity != WINDOW_OPAQUE || (window->flags & WINDOW_ALPHA))
+        frame.height = WINDOW_BAR_HEIGHT + 1;
+
+    return frame;
+}
+
+void window_damage(struct Window *window, int x, int y, int width, int height)
+{
+    struct Rect rect = {x, y, width, height};
+    struct Rect content = {0, 0, window->fb->width, window->fb->height};
+    if (!rect_intersect(&rect, &content, &rect))
+        return;
+
+    // An empty damage region would mean the whole window changed
+    if (!(window->flags & WINDOW_UPDATED))
+        region_clear(&window->damage);
+    region_add(&window->damage, &rect);
+    window->flags |= WINDOW_UPDATED;
+}
+
+/*
+    Draws the window as if it was at x, y
+*/
+static void draw_window_at(struct FrameBuffer *fb, struct Window *window, int x, int y)
 {
     // save the current color to restore it later
     Color old_color = get_color();
     Color window_bar = make_color(
         WINDOW_BAR_COLOR_R, WINDOW_BAR_COLOR_G, WINDOW_BAR_COLOR_B
     );
+    /*
+        The bar covers all of its area, so that the windows below it never 
+        have to be drawn there. The content does too unless it is 
+        translucent, then it is mixed with what was drawn below it
+    */
     fill_rect(
         fb, 
-        window->x, window->y, 
-        window->fb->width, WINDOW_BAR_HEIGHT, 
+        x, y, 
+        window->fb->width, WINDOW_BAR_HEIGHT + 1, 
         window_bar
     );
     draw_rect(
         fb, 
-        window->x, window->y, 
-        window->fb->width, WINDOW_BAR_HEIGHT, 
+        x, y, 
+        window->fb->width - 1, WINDOW_BAR_HEIGHT, 
         COLOR_WHITE
     );
-    draw_text(fb, window->x + 8, window->y + 4, window->title);
+    draw_text(fb, x + 8, y + 4, window->title);
     set_color(old_color);
     
-    fb_blit(
+    fb_blend(
         fb, window->fb, 
-        window->x, window->y + WINDOW_BAR_HEIGHT + 1, 
-        window->fb->width, window->fb->height
+        x, y + WINDOW_BAR_HEIGHT + 1, 
+        window->fb->width, window->fb->height, 
+        window->opacity, window->flags & WINDOW_ALPHA
     );
-}
\ No newline at end of file
+}
+
+void draw_window(struct FrameBuffer *fb, struct Window *window)
+{
+    draw_window_at(fb, window, window->x, window->y);
+}
+
+void draw_window_area(struct FrameBuffer *fb, struct Window *window, const struct Rect *area)
+{
+    struct FrameBuffer view;
+    int result = fb_view(fb, area->x, area->y, area->width, area->height, &view);
+    kassert(result == 0);
+
+    draw_window_at(&view, window, window->x - area->x, window->y - area->y);
+}
@@ -2,6 +2,8 @@
 #define WINDOW_H
 
 #include <kernel/devices/framebuffer.h>
+#include <kernel/lib/graphics/region.h>
+#include <kernel/memory/memory.h>
 
 #define WINDOW_BAR_HEIGHT   24
 
@@ -10,15 +12,42 @@
 #define WINDOW_BAR_COLOR_B  255
 
 
+/*
+    WINDOW_UPDATED: the parts of the content in 'damage' changed, if 
+    'damage' is empty the whole window did.
+    WINDOW_MOVED: the window is not where it was drawn last time
+    WINDOW_ALPHA: the highest byte of each pixel of the content is how much 
+    it covers what is below the window, from 0 (not at all) to 255
+*/
 #define WINDOW_UPDATED         0x1
 #define WINDOW_MOVED           0x2
+#define WINDOW_ALPHA           0x4
+
+// The opacity of a window that completely covers what is below it
+#define WINDOW_OPAQUE          255
 
 struct Window {
     char *title;
     int x, y;
     struct FrameBuffer *fb;
+    /*
+        Where the content is mapped when it is a shared memory region, so 
+        that other processes can draw in it too. 0 if it is not shared
+    */
+    vaddr_t surface;
 
     int flags;
+    /*
+        How much the content covers what is below the window, from 0 to 
+        WINDOW_OPAQUE. The bar is always opaque
+    */
+    uint8_t opacity;
+    // Where the window was drawn on the screen last time
+    int drawnX, drawnY;
+    // The areas of the content changed since the window was drawn
+    struct Region damage;
+    // The part of the screen the window draws in the current frame
+    struct Region visible;
 };
 
 /*
@@ -28,14 +57,49 @@ struct Window {
 struct Window *window_create(char *title, int x, int y, int width, int height);
 
 /*
-    Frees a previously allocated window
+    Like window_create, but the content is a new shared memory region called 
+    'name', mapped in the address space of the running process. Other 
+    processes can map it with SYS_SHMMAP and draw in the window directly.
+    Returns NULL if the region can't be created or mapped
+*/
+struct Window *window_create_shared(char *title, int x, int y, int width, int height, char *name);
+
+/*
+    Frees a previously allocated window. A shared window must be freed by 
+    the process that created it: this removes its mapping of the region, 
+    which is freed once the other processes unmap it too. Until then the 
+    mapping keeps the region alive, even if all the others are gone
 */
 void window_free(struct Window *window);
 
+/*
+    Returns the area of the screen the window covers when it is at x, y
+*/
+struct Rect window_frame(struct Window *window, int x, int y);
+
+/*
+    Returns the part of the frame of the window at x, y that completely 
+    covers what is below it: the whole frame if the content is opaque, 
+    only the bar otherwise
+*/
+struct Rect window_opaque_frame(struct Window *window, int x, int y);
+
+/*
+    Marks an area of the content of the window as changed, so that only 
+    that area is drawn again. The coordinates are relative to the content
+*/
+void window_damage(struct Window *window, int x, int y, int width, int height);
+
 /*
     Draws a window and its framebuffer on another framebuffer. Note that 
     this does NOT set the update_* flags to false
 */
 void draw_window(struct FrameBuffer *fb, struct Window *window);
 
+/*
+    Draws only the part of a window inside 'area', nothing outside of it 
+    is touched. The area must be inside the framebuffer
+*/
+void draw_window_area(struct FrameBuffer *fb, struct Window *window, const struct Rect *area);
+
 #endif
\ No newline at end of file
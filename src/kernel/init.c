@@ -12,8 +12,10 @@
 #include <kernel/devices/tty/tty.h>
 #include <kernel/devices/vdisk.h>
 #include <kernel/filesystems/fat16/fat16vfs.h>
+#include <kernel/filesystems/tmpfs/tmpfs.h>
 #include <kernel/filesystems/vfs.h>
 #include <kernel/gui/compositor.h>
+#include <kernel/gui/console.h>
 #include <kernel/lib/kassert.h>
 #include <kernel/lib/kprintf.h>
 #include <kernel/lib/read_string.h>
@@ -28,8 +30,10 @@
 #include <stdint.h>
 
 
-struct DiskInterface diskinterface;
-VFSInterface *vfsinterface;
+// Where the ramdisk is mounted when the root is on the IDE disk
+#define RAMDISK_MOUNT_PATH "/ram"
+// Where an empty tmpfs is mounted at boot
+#define TMPFS_MOUNT_PATH "/tmp"
 
 
 void kernel_setup(multiboot_info_t *header, unsigned int magic)
@@ -58,6 +62,7 @@ void kernel_setup(multiboot_info_t *header, unsigned int magic)
 
     
     kassert(0 == fb_init(header));
+    console_init();
     struct FrameBuffer *fb = get_screen_framebuffer();
 
     kprintf("Framebuffer: \n");
@@ -68,7 +73,10 @@ void kernel_setup(multiboot_info_t *header, unsigned int magic)
 
     kprintf("Checking for an IDE device...");
     
+    // The file systems keep a copy of the disk interfaces
     struct DiskInterface diskinterface;
+    VFSInterface *ide_vfs = NULL;
+    VFSInterface *ramdisk_vfs = NULL;
     struct ide_identify_format id;
     int result = ide_identify_master(&id);
     if (result == 0) {
@@ -79,26 +87,47 @@ void kernel_setup(multiboot_info_t *header, unsigned int magic)
             id.lba_capacity * 512 / 1024 / 1024
         );
         kassert(0 == ide_get_diskinterface(&diskinterface));
+        ide_vfs = fat16_get_vfsinterface(&diskinterface);
+        if (ide_vfs == NULL)
+            kprintf("The IDE device does not contain a FAT16 file system\n");
     } else {
         kprintf("not found\n");
-        kprintf("Checking for a ramdisk...");
-        struct Module *mod_ramdisk = get_module(0);
-        if (mod_ramdisk == NULL) {
-            kprintf("not found\n");
-            panic("Can't continue: no usable disk device found\n");
-        }
+    }
+
+    kprintf("Checking for a ramdisk...");
+    struct Module *mod_ramdisk = get_module(0);
+    if (mod_ramdisk != NULL) {
         kassert(0 == ramdisk_init(mod_ramdisk->start, mod_ramdisk->size));
         kassert(0 == ramdisk_get_diskinterface(&diskinterface));
         kprintf("Ramdisk at %x with %d MB\n", mod_ramdisk->start, mod_ramdisk->size / 1024 / 1024);
+        ramdisk_vfs = fat16_get_vfsinterface(&diskinterface);
+        if (ramdisk_vfs == NULL)
+            kprintf("The ramdisk does not contain a FAT16 file system\n");
+    } else {
+        kprintf("not found\n");
     }
-    
-    vfsinterface = fat16_get_vfsinterface(&diskinterface);
-    vfs_setroot(vfsinterface);
+
+    if (ide_vfs != NULL) {
+        kassert(0 == vfs_setroot(ide_vfs));
+        if (ramdisk_vfs != NULL) {
+            kassert(0 == vfs_mount(RAMDISK_MOUNT_PATH, ramdisk_vfs));
+            kprintf("Ramdisk mounted at %s\n", RAMDISK_MOUNT_PATH);
+        }
+    } else if (ramdisk_vfs != NULL) {
+        kassert(0 == vfs_setroot(ramdisk_vfs));
+    } else {
+        panic("Can't continue: no usable disk device found\n");
+    }
+
+    VFSInterface *tmpfs = tmpfs_get_vfsinterface();
+    kassert(tmpfs != NULL);
+    kassert(0 == vfs_mount(TMPFS_MOUNT_PATH, tmpfs));
+    kprintf("tmpfs mounted at %s\n", TMPFS_MOUNT_PATH);
 
     mouse_init();
 
     kprintf("Starting Compositor Server\n");
-    process_create("Compositor Server", (uint32_t) __compositor_main, paging_kernel_pgdir());
+    process_create("Compositor Server", (uint32_t) __compositor_main, paging_kernel_pgdir(), NULL);
 
     kprintf("All done. Ready to start!\n");
 }
\ No newline at end of file
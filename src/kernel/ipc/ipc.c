@@ -0,0 +1,302 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <kernel/ipc/ipc.h>
+#include <kernel/process.h>
+#include <kernel/syscall.h>
+#include <kernel/lib/kassert.h>
+#include <klibc/string.h>
+
+
+static struct Endpoint endpoints[IPC_MAX_ENDPOINTS];
+
+int ipc_endpoint_create(Process *owner, char *name)
+{
+    if (strlen(name) == 0 || strlen(name) > IPC_NAME_LEN || ipc_endpoint_lookup(name) >= 0)
+        return -1;
+
+    for (int i = 0; i < IPC_MAX_ENDPOINTS; i++) {
+        if (endpoints[i].owner == NULL) {
+            endpoints[i] = (struct Endpoint) { .owner = owner };
+            strcpy(endpoints[i].name, name);
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int ipc_endpoint_lookup(char *name)
+{
+    for (int i = 0; i < IPC_MAX_ENDPOINTS; i++) {
+        if (endpoints[i].owner != NULL && strcmp(endpoints[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static struct Endpoint *ipc_endpoint_get(uint32_t number)
+{
+    if (number >= IPC_MAX_ENDPOINTS || endpoints[number].owner == NULL)
+        return NULL;
+
+    return &endpoints[number];
+}
+
+static void ipc_frame_message(struct intframe_t *frame, struct IPCMessage *msg)
+{
+    msg->words[0] = frame->ecx;
+    msg->words[1] = frame->edx;
+    msg->words[2] = frame->esi;
+    msg->words[3] = frame->edi;
+}
+
+/*
+    Sets the result of the system call of the running process: 'status' in 
+    %eax, 'badge' in %ebx and the message, if any, in the other registers
+*/
+static void ipc_return(struct intframe_t *frame, int status, uint32_t badge, struct IPCMessage *msg)
+{
+    frame->eax = status;
+    frame->ebx = badge;
+    if (msg != NULL) {
+        frame->ecx = msg->words[0];
+        frame->edx = msg->words[1];
+        frame->esi = msg->words[2];
+        frame->edi = msg->words[3];
+    }
+}
+
+/*
+    Like ipc_return, but for a process that is not running: its saved 
+    registers are changed, they are loaded when it runs again
+*/
+static void ipc_return_to(Process *proc, int status, uint32_t badge, struct IPCMessage *msg)
+{
+    proc->registers.eax = status;
+    proc->registers.ebx = badge;
+    if (msg != NULL) {
+        proc->registers.ecx = msg->words[0];
+        proc->registers.edx = msg->words[1];
+        proc->registers.esi = msg->words[2];
+        proc->registers.edi = msg->words[3];
+    }
+}
+
+static void ipc_wake(Process *proc, int status, uint32_t badge, struct IPCMessage *msg)
+{
+    ipc_return_to(proc, status, badge, msg);
+    proc->state = PROC_STATE_READY;
+    proc->waitChannel = NULL;
+}
+
+/*
+    A server must reply before receiving the next message: the call it 
+    left without a reply fails
+*/
+static void ipc_drop_reply(Process *server)
+{
+    if (server->ipcReplyTo != NULL) {
+        ipc_wake(server->ipcReplyTo, -1, 0, NULL);
+        server->ipcReplyTo = NULL;
+    }
+}
+
+static void ipc_enqueue(struct Endpoint *ep, Process *proc)
+{
+    proc->ipcNext = NULL;
+    if (ep->sendersTail != NULL)
+        ep->sendersTail->ipcNext = proc;
+    else
+        ep->sendersHead = proc;
+    ep->sendersTail = proc;
+}
+
+static Process *ipc_dequeue(struct Endpoint *ep)
+{
+    Process *proc = ep->sendersHead;
+    if (proc != NULL) {
+        ep->sendersHead = proc->ipcNext;
+        if (ep->sendersHead == NULL)
+            ep->sendersTail = NULL;
+        proc->ipcNext = NULL;
+    }
+
+    return proc;
+}
+
+/*
+    The running process waits for 'server' to reply to its call
+*/
+static void ipc_wait_reply(Process *caller, Process *server)
+{
+    ipc_drop_reply(server);
+    server->ipcReplyTo = caller;
+    caller->state = PROC_STATE_WAITING;
+    caller->waitChannel = server;
+}
+
+static void ipc_send(struct intframe_t *frame, bool call)
+{
+    Process *proc = get_running_process();
+    struct Endpoint *ep = ipc_endpoint_get(frame->ebx);
+    if (ep == NULL || ep->owner == proc) {
+        ipc_return(frame, -1, 0, NULL);
+        return;
+    }
+
+    struct IPCMessage msg;
+    ipc_frame_message(frame, &msg);
+    if (ep->receiver != NULL) {
+        // The owner is waiting: hand the message and the cpu over to it
+        Process *receiver = ep->receiver;
+        ep->receiver = NULL;
+        ipc_return_to(receiver, 0, proc->pid, &msg);
+        receiver->waitChannel = NULL;
+        if (call) {
+            ipc_wait_reply(proc, receiver);
+        } else {
+            ipc_return(frame, 0, 0, NULL);
+        }
+        scheduler_switch(frame, receiver);
+        return;
+    }
+
+    proc->ipcMessage = msg;
+    proc->ipcCall = call;
+    ipc_enqueue(ep, proc);
+    proc->state = PROC_STATE_WAITING;
+    proc->waitChannel = ep;
+    // The owner is busy with something else, let it get to the message sooner
+    if (ep->owner->state == PROC_STATE_READY) {
+        scheduler_switch(frame, ep->owner);
+    } else {
+        scheduler(frame);
+    }
+}
+
+/*
+    Gives the running process, the owner of 'ep', the first message waiting 
+    on the endpoint. If there is none, it waits for one when 'block' is 
+    true and 'next' (if not NULL) runs in the meantime, otherwise -1 is 
+    returned
+*/
+static void ipc_receive(struct intframe_t *frame, struct Endpoint *ep, bool block, Process *next)
+{
+    Process *proc = get_running_process();
+    ipc_drop_reply(proc);
+
+    Process *sender = ipc_dequeue(ep);
+    if (sender != NULL) {
+        ipc_return(frame, 0, sender->pid, &sender->ipcMessage);
+        if (sender->ipcCall) {
+            proc->ipcReplyTo = sender;
+            sender->waitChannel = proc;
+        } else {
+            ipc_wake(sender, 0, 0, NULL);
+        }
+        if (next != NULL)
+            scheduler_switch(frame, next);
+        return;
+    }
+
+    if (!block) {
+        ipc_return(frame, -1, 0, NULL);
+        if (next != NULL)
+            scheduler_switch(frame, next);
+        return;
+    }
+    ep->receiver = proc;
+    proc->state = PROC_STATE_WAITING;
+    proc->waitChannel = ep;
+    if (next != NULL) {
+        scheduler_switch(frame, next);
+    } else {
+        scheduler(frame);
+    }
+}
+
+/*
+    Wakes up the caller the running process has to reply to with the 
+    message in the frame.
+    Returns the caller, NULL if there is none
+*/
+static Process *ipc_reply(struct intframe_t *frame)
+{
+    Process *proc = get_running_process();
+    Process *caller = proc->ipcReplyTo;
+    if (caller == NULL)
+        return NULL;
+
+    struct IPCMessage msg;
+    ipc_frame_message(frame, &msg);
+    proc->ipcReplyTo = NULL;
+    ipc_wake(caller, 0, proc->pid, &msg);
+
+    return caller;
+}
+
+bool ipc_is_syscall(uint32_t number)
+{
+    return number >= SYS_IPC_SEND && number <= SYS_IPC_REPLYRECEIVE;
+}
+
+void ipc_syscall(struct intframe_t *frame)
+{
+    Process *proc = get_running_process();
+    struct Endpoint *ep;
+    Process *caller;
+
+    switch (frame->eax) {
+    case SYS_IPC_SEND:
+        ipc_send(frame, false);
+        break;
+    case SYS_IPC_CALL:
+        ipc_send(frame, true);
+        break;
+    case SYS_IPC_RECEIVE:
+        ep = ipc_endpoint_get(frame->ebx);
+        if (ep == NULL || ep->owner != proc) {
+            ipc_return(frame, -1, 0, NULL);
+            break;
+        }
+        ipc_receive(frame, ep, !(frame->ecx & IPC_NONBLOCK), NULL);
+        break;
+    case SYS_IPC_REPLY:
+        caller = ipc_reply(frame);
+        if (caller == NULL) {
+            ipc_return(frame, -1, 0, NULL);
+            break;
+        }
+        // The caller was waiting on this, it gets to run right away
+        ipc_return(frame, 0, 0, NULL);
+        scheduler_switch(frame, caller);
+        break;
+    case SYS_IPC_REPLYRECEIVE:
+        ep = ipc_endpoint_get(frame->ebx);
+        if (ep == NULL || ep->owner != proc) {
+            ipc_return(frame, -1, 0, NULL);
+            break;
+        }
+        caller = ipc_reply(frame);
+        ipc_receive(frame, ep, true, caller);
+        break;
+    }
+}
+
+void ipc_release(Process *proc)
+{
+    ipc_drop_reply(proc);
+    for (int i = 0; i < IPC_MAX_ENDPOINTS; i++) {
+        struct Endpoint *ep = &endpoints[i];
+        if (ep->owner != proc)
+            continue;
+
+        Process *sender;
+        while ((sender = ipc_dequeue(ep)) != NULL)
+            ipc_wake(sender, -1, 0, NULL);
+        ep->owner = NULL;
+        ep->receiver = NULL;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/arch/i386/boot/descriptor_tables.h>
+
+// How many endpoints can exist at the same time
+#define IPC_MAX_ENDPOINTS   16
+#define IPC_NAME_LEN        31
+
+// A message is made of this many words, passed in %ecx, %edx, %esi, %edi
+#define IPC_MESSAGE_WORDS   4
+
+// For SYS_IPC_RECEIVE: return -1 instead of waiting if nobody is sending
+#define IPC_NONBLOCK        0x1
+
+struct IPCMessage {
+    uint32_t words[IPC_MESSAGE_WORDS];
+};
+
+struct Process;
+
+/*
+    A named point where processes send messages to the process that created 
+    it, its owner. Messages are synchronous: a sender waits until the owner 
+    receives the message and a caller also waits for the reply. When both 
+    sides are ready the message goes straight into the registers of the 
+    other process, which runs right away without going through the round 
+    robin of the scheduler
+*/
+struct Endpoint {
+    char name[IPC_NAME_LEN + 1];
+    // NULL if the slot is unused
+    struct Process *owner;
+    // The owner when it is waiting in SYS_IPC_RECEIVE, NULL otherwise
+    struct Process *receiver;
+    // The processes waiting for the owner to receive their message, in order
+    struct Process *sendersHead;
+    struct Process *sendersTail;
+};
+
+/*
+    Creates an endpoint called 'name' owned by 'owner'.
+    Returns the number of the endpoint, -1 if the name is not valid or 
+    already used or there are too many endpoints
+*/
+int ipc_endpoint_create(struct Process *owner, char *name);
+
+/*
+    Returns the number of the endpoint called 'name', -1 if there is none
+*/
+int ipc_endpoint_lookup(char *name);
+
+/*
+    Returns true if 'number' is one of the system calls handled by 
+    ipc_syscall
+*/
+bool ipc_is_syscall(uint32_t number);
+
+/*
+    Handles SYS_IPC_SEND, SYS_IPC_CALL, SYS_IPC_RECEIVE, SYS_IPC_REPLY and 
+    SYS_IPC_REPLYRECEIVE for the running process. Unlike the other system 
+    calls these can return values in all the registers and switch process 
+    on their own, so they work on the whole interrupt frame. Do NOT call 
+    this outside the interrupt handler
+*/
+void ipc_syscall(struct intframe_t *frame);
+
+/*
+    Destroys the endpoints of a process and fails the calls it still had to 
+    reply to, to be called when the process is freed
+*/
+void ipc_release(struct Process *proc);
+
+/*
+    These make the IPC system calls with 'int $0x80', for programs whose code 
+    is in the kernel like the compositor. The message is replaced by the one 
+    received, if any, and 'badge' is set to the pid of the sender
+*/
+static inline int ipc_syscall_raw(uint32_t number, uint32_t arg, struct IPCMessage *msg, uint32_t *badge)
+{
+    uint32_t eax = number, ebx = arg;
+    uint32_t *w = msg->words;
+    asm volatile (
+        "int $0x80"
+        : "+a"(eax), "+b"(ebx), "+c"(w[0]), "+d"(w[1]), "+S"(w[2]), "+D"(w[3])
+        :
+        : "memory"
+    );
+    if (badge != NULL)
+        *badge = ebx;
+
+    return eax;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <kernel/ipc/pipe.h>
+#include <kernel/process.h>
+#include <kernel/arch/i386/paging.h>
+#include <kernel/memory/kheap.h>
+#include <kernel/lib/kassert.h>
+#include <kernel/lib/util.h>
+#include <klibc/string.h>
+
+// Keeps the compiler from moving the accesses to the buffer past the counters
+#define PIPE_BARRIER() asm volatile ("" : : : "memory")
+
+
+struct Pipe *pipe_create(void)
+{
+    struct Pipe *pipe = (struct Pipe *) kmalloc(sizeof(struct Pipe));
+    if (pipe == NULL)
+        return NULL;
+    struct PageInfo *page = page_alloc(1);
+    if (page == NULL) {
+        kfree(pipe);
+        return NULL;
+    }
+
+    pipe->buffer = (char *) page2addr(page);
+    pipe->head = 0;
+    pipe->tail = 0;
+    pipe->readers = 1;
+    pipe->writers = 1;
+
+    return pipe;
+}
+
+void pipe_open(struct Pipe *pipe, int end)
+{
+    if (end == PIPE_END_READ)
+        pipe->readers++;
+    else
+        pipe->writers++;
+}
+
+void pipe_close(struct Pipe *pipe, int end)
+{
+    if (end == PIPE_END_READ) {
+        kassert(pipe->readers > 0);
+        pipe->readers--;
+    } else {
+        kassert(pipe->writers > 0);
+        pipe->writers--;
+    }
+
+    if (pipe->readers == 0 && pipe->writers == 0) {
+        page_free(addr2page(pipe->buffer));
+        kfree(pipe);
+    } else {
+        process_wakeup(pipe);
+    }
+}
+
+int pipe_readv(struct Pipe *pipe, struct IOVec *iov, int count)
+{
+    const uint32_t tail = pipe->tail;
+    const uint32_t available = pipe->head - tail;
+    PIPE_BARRIER();
+
+    uint32_t read = 0;
+    for (int i = 0; i < count && read < available; i++) {
+        uint32_t wanted = MIN((uint32_t) iov[i].length, available - read);
+        for (uint32_t done = 0; done < wanted; ) {
+            // The bytes up to the end of the buffer, then from its start
+            uint32_t position = (tail + read) & (PIPE_SIZE - 1);
+            uint32_t chunk = MIN(wanted - done, PIPE_SIZE - position);
+            memcpy(iov[i].base + done, pipe->buffer + position, chunk);
+            done += chunk;
+            read += chunk;
+        }
+    }
+
+    PIPE_BARRIER();
+    pipe->tail = tail + read;
+    if (read > 0)
+        process_wakeup(pipe);
+
+    return read;
+}
+
+int pipe_writev(struct Pipe *pipe, struct IOVec *iov, int count)
+{
+    const uint32_t head = pipe->head;
+    const uint32_t space = PIPE_SIZE - (head - pipe->tail);
+    PIPE_BARRIER();
+
+    uint32_t written = 0;
+    for (int i = 0; i < count && written < space; i++) {
+        uint32_t wanted = MIN((uint32_t) iov[i].length, space - written);
+        for (uint32_t done = 0; done < wanted; ) {
+            uint32_t position = (head + written) & (PIPE_SIZE - 1);
+            uint32_t chunk = MIN(wanted - done, PIPE_SIZE - position);
+            memcpy(pipe->buffer + position, iov[i].base + done, chunk);
+            done += chunk;
+            written += chunk;
+        }
+    }
+
+    PIPE_BARRIER();
+    pipe->head = head + written;
+    if (written > 0)
+        process_wakeup(pipe);
+
+    return written;
+}
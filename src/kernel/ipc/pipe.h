@@ -0,0 +1,66 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/arch/i386/paging.h>
+#include <kernel/lib/iovec.h>
+
+// The size of the ring buffer of a pipe, it must be a power of 2
+#define PIPE_SIZE           PGSIZE
+
+#define PIPE_END_READ       0
+#define PIPE_END_WRITE      1
+
+/*
+    A byte stream between processes, kept in a ring buffer of a single page. 
+    'head' and 'tail' count all the bytes ever written and read: they are 
+    never wrapped, the position in the buffer is taken with a mask and the 
+    bytes in the pipe are always head - tail. The writer only moves 'head' 
+    and the reader only moves 'tail', so the two sides never need a lock.
+    The pipe is freed when both of its ends are closed
+*/
+struct Pipe {
+    char *buffer;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    // How many descriptors refer to each end of the pipe
+    int readers;
+    int writers;
+};
+
+/*
+    Creates an empty pipe with one reference to each of its ends.
+    Returns NULL if there is no memory for it
+*/
+struct Pipe *pipe_create(void);
+
+/*
+    Takes another reference to an end of the pipe, PIPE_END_READ or 
+    PIPE_END_WRITE
+*/
+void pipe_open(struct Pipe *pipe, int end);
+
+/*
+    Drops a reference to an end of the pipe. The processes waiting on the 
+    pipe are woken up, so that they can see that the other side is gone
+*/
+void pipe_close(struct Pipe *pipe, int end);
+
+/*
+    Moves the bytes in the pipe into the segments, one after the other, up 
+    to their total length. This never waits: the processes waiting to write 
+    are woken up if something was read.
+    Returns the number of bytes read, 0 if the pipe is empty
+*/
+int pipe_readv(struct Pipe *pipe, struct IOVec *iov, int count);
+
+/*
+    Puts the bytes of the segments in the pipe, as many as fit. This never 
+    waits: the processes waiting to read are woken up if something was 
+    written.
+    Returns the number of bytes written, 0 if the pipe is full
+*/
+int pipe_writev(struct Pipe *pipe, struct IOVec *iov, int count);
+
+#endif
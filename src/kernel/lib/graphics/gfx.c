@@ -52,10 +52,10 @@ void draw_rect(
     for (int ypos = y; ypos < y + height; ypos++) {
         if (ypos >= screenh)
             break;
-        if (ypos > 0) {
+        if (ypos >= 0) {
             if (x >= 0 && x < screenw)
                 *left = color;
-            if (x+width >= 0 && x+width <= screenw)
+            if (x+width >= 0 && x+width < screenw)
                 *right = color;
         }
         
@@ -71,25 +71,12 @@ void fill_rect(
     Color color
 )
 {
-    /*
-        TODO: Optimize this to avoid all those IFs in the loops
-    */
-    const int screenw = fb->width;
-    const int screenh = fb->height;
+    if (!fb_clip(fb, &x, &y, &width, &height))
+        return;
 
-    uint32_t *addr = (uint32_t *) (fb->addr + y * fb->pitch);
+    char *row = fb->addr + fb_offset(fb, x, y);
     for (int i = 0; i < height; i++) {
-        if (y + i >= screenh)
-            break;
-        if (y + i >= 0) {
-            for (int j = 0; j < width; j++) {
-                if (x + j < 0)
-                    continue;
-                if (x + j >= screenw)
-                    break;
-                addr[x+j] = color;
-            }
-        }
-        MOVE_PTR(addr, uint32_t, fb->pitch);
+        fb_fill_pixels((uint32_t *) row, color, width);
+        row += fb->pitch;
     }
-}
\ No newline at end of file
+}
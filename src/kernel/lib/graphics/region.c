@@ -0,0 +1,234 @@
+#include <stdbool.h>
+#include <kernel/lib/graphics/region.h>
+#include <kernel/lib/util.h>
+
+
+bool rect_is_empty(const struct Rect *rect)
+{
+    return rect->width <= 0 || rect->height <= 0;
+}
+
+bool rect_intersect(const struct Rect *a, const struct Rect *b, struct Rect *out)
+{
+    int left = MAX(a->x, b->x);
+    int top = MAX(a->y, b->y);
+    int right = MIN(a->x + a->width, b->x + b->width);
+    int bottom = MIN(a->y + a->height, b->y + b->height);
+    if (left >= right || top >= bottom)
+        return false;
+
+    out->x = left;
+    out->y = top;
+    out->width = right - left;
+    out->height = bottom - top;
+
+    return true;
+}
+
+/*
+    Returns the smallest rectangle that contains both 'a' and 'b'
+*/
+static struct Rect rect_bounds(const struct Rect *a, const struct Rect *b)
+{
+    if (rect_is_empty(a))
+        return *b;
+    if (rect_is_empty(b))
+        return *a;
+
+    struct Rect out;
+    out.x = MIN(a->x, b->x);
+    out.y = MIN(a->y, b->y);
+    out.width = MAX(a->x + a->width, b->x + b->width) - out.x;
+    out.height = MAX(a->y + a->height, b->y + b->height) - out.y;
+
+    return out;
+}
+
+void region_clear(struct Region *region)
+{
+    region->count = 0;
+}
+
+bool region_is_empty(const struct Region *region)
+{
+    return region->count == 0;
+}
+
+struct Rect region_bounds(const struct Region *region)
+{
+    struct Rect bounds = {0, 0, 0, 0};
+    for (int i = 0; i < region->count; i++)
+        bounds = rect_bounds(&bounds, &region->rects[i]);
+
+    return bounds;
+}
+
+/*
+    Replaces the region with a single rectangle covering it and 'extra'.
+    Used when the exact result doesn't fit
+*/
+static void region_collapse(struct Region *region, const struct Rect *extra)
+{
+    struct Rect bounds = rect_bounds(&(struct Rect) {0, 0, 0, 0}, extra);
+    for (int i = 0; i < region->count; i++)
+        bounds = rect_bounds(&bounds, &region->rects[i]);
+
+    region->count = 0;
+    if (!rect_is_empty(&bounds))
+        region->rects[region->count++] = bounds;
+}
+
+/*
+    Joins the rectangles that share a whole side, so that regions built a
+    piece at a time don't fill up with slivers
+*/
+static void region_coalesce(struct Region *region)
+{
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < region->count; i++) {
+            for (int j = i + 1; j < region->count; j++) {
+                struct Rect *a = &region->rects[i];
+                struct Rect *b = &region->rects[j];
+                bool same_columns = a->x == b->x && a->width == b->width;
+                bool same_rows = a->y == b->y && a->height == b->height;
+                if (same_columns && (a->y + a->height == b->y || b->y + b->height == a->y)) {
+                    a->y = MIN(a->y, b->y);
+                    a->height += b->height;
+                } else if (same_rows && (a->x + a->width == b->x || b->x + b->width == a->x)) {
+                    a->x = MIN(a->x, b->x);
+                    a->width += b->width;
+                } else {
+                    continue;
+                }
+                region->rects[j] = region->rects[--region->count];
+                merged = true;
+                j--;
+            }
+        }
+    }
+}
+
+/*
+    Removes 'rect' from the region, each rectangle it overlaps is split in
+    up to 4 pieces around it.
+    Returns false and leaves the region unchanged if the pieces don't fit
+*/
+static bool region_subtract_exact(struct Region *region, const struct Rect *rect)
+{
+    struct Region result;
+    result.count = 0;
+    for (int i = 0; i < region->count; i++) {
+        const struct Rect *r = &region->rects[i];
+        struct Rect hole;
+        if (!rect_intersect(r, rect, &hole)) {
+            if (result.count == REGION_MAX_RECTS)
+                return false;
+            result.rects[result.count++] = *r;
+            continue;
+        }
+
+        struct Rect pieces[4] = {
+            // Above, below, left and right of the hole
+            {r->x, r->y, r->width, hole.y - r->y},
+            {r->x, hole.y + hole.height, r->width, r->y + r->height - hole.y - hole.height},
+            {r->x, hole.y, hole.x - r->x, hole.height},
+            {hole.x + hole.width, hole.y, r->x + r->width - hole.x - hole.width, hole.height}
+        };
+        for (int k = 0; k < 4; k++) {
+            if (rect_is_empty(&pieces[k]))
+                continue;
+            if (result.count == REGION_MAX_RECTS)
+                return false;
+            result.rects[result.count++] = pieces[k];
+        }
+    }
+
+    *region = result;
+    region_coalesce(region);
+
+    return true;
+}
+
+void region_add(struct Region *region, const struct Rect *rect)
+{
+    if (rect_is_empty(rect))
+        return;
+
+    // Only the parts of 'rect' the region doesn't cover yet are added
+    struct Region pieces;
+    pieces.count = 1;
+    pieces.rects[0] = *rect;
+    for (int i = 0; i < region->count && pieces.count > 0; i++) {
+        if (!region_subtract_exact(&pieces, &region->rects[i])) {
+            region_collapse(region, rect);
+            return;
+        }
+    }
+
+    if (region->count + pieces.count > REGION_MAX_RECTS) {
+        region_collapse(region, rect);
+        return;
+    }
+    for (int i = 0; i < pieces.count; i++)
+        region->rects[region->count++] = pieces.rects[i];
+    region_coalesce(region);
+}
+
+void region_union(struct Region *region, const struct Region *other)
+{
+    for (int i = 0; i < other->count; i++)
+        region_add(region, &other->rects[i]);
+}
+
+void region_subtract(struct Region *region, const struct Rect *rect)
+{
+    // If the exact result doesn't fit the region keeps covering 'rect'
+    region_subtract_exact(region, rect);
+}
+
+void region_subtract_region(struct Region *region, const struct Region *other)
+{
+    for (int i = 0; i < other->count && region->count > 0; i++)
+        region_subtract_exact(region, &other->rects[i]);
+}
+
+void region_clip(struct Region *region, const struct Rect *rect)
+{
+    int kept = 0;
+    for (int i = 0; i < region->count; i++) {
+        if (rect_intersect(&region->rects[i], rect, &region->rects[kept]))
+            kept++;
+    }
+    region->count = kept;
+}
+
+void region_intersect(const struct Region *a, const struct Region *b, struct Region *out)
+{
+    struct Rect r;
+    bool collapsed = false;
+    // The rectangles of each region don't overlap, so neither do the results
+    out->count = 0;
+    for (int i = 0; i < a->count; i++) {
+        for (int j = 0; j < b->count; j++) {
+            if (!rect_intersect(&a->rects[i], &b->rects[j], &r))
+                continue;
+            if (collapsed || out->count == REGION_MAX_RECTS) {
+                region_collapse(out, &r);
+                collapsed = true;
+            } else {
+                out->rects[out->count++] = r;
+            }
+        }
+    }
+    region_coalesce(out);
+}
+
+void region_translate(struct Region *region, int dx, int dy)
+{
+    for (int i = 0; i < region->count; i++) {
+        region->rects[i].x += dx;
+        region->rects[i].y += dy;
+    }
+}
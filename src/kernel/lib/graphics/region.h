@@ -0,0 +1,85 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdbool.h>
+
+/*
+    How many rectangles a region can hold. When an operation would need
+    more the region is made larger than the exact result, never smaller, so
+    that it can still be used to decide what to repaint
+*/
+#define REGION_MAX_RECTS 32
+
+struct Rect {
+    int x, y;
+    int width, height;
+};
+
+/*
+    An area of the screen described as a list of rectangles that don't
+    overlap each other
+*/
+struct Region {
+    int count;
+    struct Rect rects[REGION_MAX_RECTS];
+};
+
+/*
+    Returns true if the rectangle covers no pixels
+*/
+bool rect_is_empty(const struct Rect *rect);
+
+/*
+    Writes in 'out' the part of 'a' that is also in 'b'.
+    Returns false if the two rectangles don't overlap
+*/
+bool rect_intersect(const struct Rect *a, const struct Rect *b, struct Rect *out);
+
+/*
+    Makes the region empty
+*/
+void region_clear(struct Region *region);
+
+bool region_is_empty(const struct Region *region);
+
+/*
+    Returns the smallest rectangle that contains the whole region
+*/
+struct Rect region_bounds(const struct Region *region);
+
+/*
+    Adds the area of 'rect' to the region
+*/
+void region_add(struct Region *region, const struct Rect *rect);
+
+/*
+    Adds the area of 'other' to the region
+*/
+void region_union(struct Region *region, const struct Region *other);
+
+/*
+    Removes the area of 'rect' from the region
+*/
+void region_subtract(struct Region *region, const struct Rect *rect);
+
+/*
+    Removes the area of 'other' from the region
+*/
+void region_subtract_region(struct Region *region, const struct Region *other);
+
+/*
+    Keeps only the part of the region that is inside 'rect'
+*/
+void region_clip(struct Region *region, const struct Rect *rect);
+
+/*
+    Writes in 'out' the area that is both in 'a' and in 'b'
+*/
+void region_intersect(const struct Region *a, const struct Region *b, struct Region *out);
+
+/*
+    Moves every rectangle of the region by 'dx', 'dy'
+*/
+void region_translate(struct Region *region, int dx, int dy);
+
+#endif
@@ -1,8 +1,10 @@
 #include <stdbool.h>
+#include <stddef.h>
 #include <kernel/lib/graphics/gfx.h>
 #include <kernel/devices/framebuffer.h>
 #include <kernel/lib/graphics/text.h>
 #include <kernel/lib/kassert.h>
+#include <klibc/string.h>
 
 
 static char fontdata[] = {
@@ -10,60 +12,107 @@ static char fontdata[] = {
 };
 
 /*
-    Returns the offset in a PSF1 Font File from where the data for the given 
-    character starts
+    The glyphs of the font expanded once from the PSF1 data, so that 
+    drawing never has to parse the font again. Row 'i' of glyph 'g' is 
+    rows[g][i]: bit 'j' is set if the pixel 'j' from the left is drawn
 */
-static int psf_charoffset(char *font, char c) {
-    struct PSF1Header *header = (struct PSF1Header *) font;
+static struct {
+    bool ready;
+    int count;
+    int height;
+    uint32_t rows[TEXT_MAX_GLYPHS][TEXT_MAX_GLYPH_HEIGHT];
+} atlas;
+
+static void atlas_build(void)
+{
+    struct PSF1Header *header = (struct PSF1Header *) fontdata;
     kassert(header->magic == PSF1_MAGIC);
-    return sizeof(struct PSF1Header) + ( (int) c * header->charsize);
+    kassert(header->charsize <= TEXT_MAX_GLYPH_HEIGHT);
+    atlas.count = header->mode & PSF1_MODE512 ? 512 : 256;
+    atlas.height = header->charsize;
+
+    const unsigned char *glyphs = (unsigned char *) fontdata + sizeof(struct PSF1Header);
+    for (int g = 0; g < atlas.count; g++) {
+        for (int i = 0; i < atlas.height; i++) {
+            // In the font the leftmost pixel is the highest bit
+            const unsigned char bits = glyphs[g * atlas.height + i];
+            uint32_t mask = 0;
+            for (int j = 0; j < PSF1_GLYPH_WIDTH; j++) {
+                if (bits & (0x80 >> j))
+                    mask |= 1U << j;
+            }
+            atlas.rows[g][i] = mask;
+        }
+    }
+    atlas.ready = true;
 }
 
-static int psf_charheight(char *font) {
-    struct PSF1Header *header = (struct PSF1Header *) font;
-    kassert(header->magic == PSF1_MAGIC);
-    return header->charsize;;
+int text_glyph_width(void)
+{
+    return PSF1_GLYPH_WIDTH;
 }
 
-int draw_char(struct FrameBuffer *fb, int x, int y, char c)
+int text_glyph_height(void)
 {
-    const int screenw = fb->width;
-    const int screenh = fb->height;
-    int charoffset = psf_charoffset(fontdata, c);
-    if (charoffset < 0)
-        return -1;
-    int charheight = psf_charheight(fontdata);
-    /*
-        TODO: Optimize this to avoid all these IFs in the loop
-    */
-    Color color = get_color();
-    for (int row = 0; row < charheight; row++) {
-        if (y+row < 0)
-            continue;
-        if (y+row >= screenh)
-            break;
-        for (int j = 7; j >= 0; j--) {
-            if (x + (7 - j) < 0)
-                continue;
-            if (x + (7 - j) >= screenw)
-                break;
-            if ((fontdata[charoffset + row] >> j) & 0x1) {
-                int offset = fb_offset(fb, x + (7 - j), y + row);
-                uint32_t *addr = (uint32_t *) (fb->addr + offset);
-                *addr = color;
+    if (!atlas.ready)
+        atlas_build();
+
+    return atlas.height;
+}
+
+/*
+    The string is clipped to the framebuffer once, then each row of the 
+    string is drawn by setting only the pixels in the masks of the glyphs
+*/
+void draw_chars(struct FrameBuffer *fb, int x, int y, const char *text, int length)
+{
+    if (!atlas.ready)
+        atlas_build();
+
+    int left = x, top = y;
+    int width = length * PSF1_GLYPH_WIDTH, height = atlas.height;
+    if (!fb_clip(fb, &left, &top, &width, &height))
+        return;
+
+    const Color color = get_color();
+    const int first = (left - x) / PSF1_GLYPH_WIDTH;
+    const int last = (left - x + width - 1) / PSF1_GLYPH_WIDTH;
+    char *row = fb->addr + fb_offset(fb, 0, top);
+    for (int i = 0; i < height; i++) {
+        uint32_t *pixels = (uint32_t *) row;
+        const int glyph_row = top - y + i;
+        for (int c = first; c <= last; c++) {
+            const int gx = x + c * PSF1_GLYPH_WIDTH;
+            uint32_t mask = atlas.rows[(unsigned char) text[c]][glyph_row];
+            // Only the first and last glyph can be partly outside
+            if (gx < left)
+                mask &= ~0U << (left - gx);
+            if (gx + PSF1_GLYPH_WIDTH > left + width)
+                mask &= (1U << (left + width - gx)) - 1;
+            while (mask != 0) {
+                pixels[gx + __builtin_ctz(mask)] = color;
+                mask &= mask - 1;
             }
         }
+        row += fb->pitch;
     }
+}
+
+int draw_char(struct FrameBuffer *fb, int x, int y, char c)
+{
+    if (!atlas.ready)
+        atlas_build();
+    if ((unsigned char) c >= atlas.count)
+        return -1;
+
+    draw_chars(fb, x, y, &c, 1);
 
     return 0;
 }
 
 int draw_text(struct FrameBuffer *fb, int x, int y, const char *text)
 {
-    for (int i = 0; text[i]; i++) {
-        if (draw_char(fb, x + 12 * i, y, text[i]) != 0)
-            return -1;
-    }
+    draw_chars(fb, x, y, text, strlen(text));
 
     return 0;
-}
\ No newline at end of file
+}
@@ -23,6 +23,22 @@ struct PSF1Header {
     uint8_t charsize; // the heigth of a single character
 };
 
+// The characters of a PSF1 font are all 8 pixels wide
+#define PSF1_GLYPH_WIDTH        8
+
+#define TEXT_MAX_GLYPHS         512
+#define TEXT_MAX_GLYPH_HEIGHT   32
+
+/*
+    Returns how far apart the characters of a string are drawn, in pixels
+*/
+int text_glyph_width(void);
+
+/*
+    Returns the height of a character, in pixels
+*/
+int text_glyph_height(void);
+
 /*
     Draws a single character using the currently selected color on the 
     argument framebuffer at a given position. 
@@ -31,10 +47,18 @@ struct PSF1Header {
 */
 int draw_char(struct FrameBuffer *fb, int x, int y, char c);
 
+/*
+    Draws 'length' characters one after the other using the currently 
+    selected color, the same as draw_text. The characters don't need to 
+    end with a null byte
+*/
+void draw_chars(struct FrameBuffer *fb, int x, int y, const char *text, int length);
+
 /*
     Draws a string using the currently selected color at a position on the
     argument framebuffer, at a given position. This does no wrapping around 
-    or any text transformation. 
+    or any text transformation, each character is text_glyph_width pixels 
+    to the right of the previous one. 
     Returns 0 on success, -1 if any character has not been drawn because of an 
     error with draw_char
 */
@@ -0,0 +1,90 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <kernel/lib/iovec.h>
+#include <kernel/lib/util.h>
+#include <kernel/lib/kassert.h>
+#include <klibc/string.h>
+
+
+int iovec_length(struct IOVec *iov, int count)
+{
+    int length = 0;
+    for (int i = 0; i < count; i++)
+        length += iov[i].length;
+
+    return length;
+}
+
+/*
+    Moves the cursor past the empty segments and the ones it is at the end of
+*/
+static void iocursor_settle(struct IOCursor *cursor)
+{
+    while (cursor->index < cursor->count &&
+            cursor->offset == cursor->iov[cursor->index].length) {
+        cursor->index++;
+        cursor->offset = 0;
+    }
+}
+
+void iocursor_init(struct IOCursor *cursor, struct IOVec *iov, int count)
+{
+    cursor->iov = iov;
+    cursor->count = count;
+    cursor->index = 0;
+    cursor->offset = 0;
+    iocursor_settle(cursor);
+}
+
+int iocursor_contiguous(struct IOCursor *cursor)
+{
+    if (cursor->index >= cursor->count)
+        return 0;
+
+    return cursor->iov[cursor->index].length - cursor->offset;
+}
+
+char *iocursor_ptr(struct IOCursor *cursor)
+{
+    return cursor->iov[cursor->index].base + cursor->offset;
+}
+
+void iocursor_skip(struct IOCursor *cursor, int bytes)
+{
+    while (bytes > 0) {
+        int step = MIN(bytes, iocursor_contiguous(cursor));
+        kassert(step > 0);
+        cursor->offset += step;
+        bytes -= step;
+        iocursor_settle(cursor);
+    }
+}
+
+int iocursor_copy(struct IOCursor *cursor, char *dest, int bytes)
+{
+    int copied = 0;
+    while (copied < bytes && iocursor_contiguous(cursor) > 0) {
+        int step = MIN(bytes - copied, iocursor_contiguous(cursor));
+        memcpy(dest + copied, iocursor_ptr(cursor), step);
+        iocursor_skip(cursor, step);
+        copied += step;
+    }
+
+    return copied;
+}
+
+int iocursor_slice(struct IOCursor *cursor, int bytes, struct IOVec *out, int max, int *taken)
+{
+    int slices = 0;
+    *taken = 0;
+    while (*taken < bytes && slices < max && iocursor_contiguous(cursor) > 0) {
+        int step = MIN(bytes - *taken, iocursor_contiguous(cursor));
+        out[slices].base = iocursor_ptr(cursor);
+        out[slices].length = step;
+        slices++;
+        iocursor_skip(cursor, step);
+        *taken += step;
+    }
+
+    return slices;
+}
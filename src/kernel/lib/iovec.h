@@ -0,0 +1,66 @@
+#ifndef IOVEC_H
+#define IOVEC_H
+
+/*
+    A segment of memory for vectored reads and writes. An array of these is
+    treated as a single buffer, made by the segments one after the other
+*/
+struct IOVec {
+    char *base;
+    int length;
+};
+
+/*
+    A position inside an array of IOVec, used to walk it a piece at a time
+*/
+struct IOCursor {
+    struct IOVec *iov;
+    int count;
+    // The segment the cursor is in and the offset inside it
+    int index;
+    int offset;
+};
+
+/*
+    Returns the sum of the lengths of the segments
+*/
+int iovec_length(struct IOVec *iov, int count);
+
+/*
+    Places the cursor at the start of the first segment
+*/
+void iocursor_init(struct IOCursor *cursor, struct IOVec *iov, int count);
+
+/*
+    Returns how many bytes can be read from the cursor position without
+    moving to another segment, 0 at the end of the array
+*/
+int iocursor_contiguous(struct IOCursor *cursor);
+
+/*
+    Returns the address of the cursor position, valid for
+    iocursor_contiguous bytes
+*/
+char *iocursor_ptr(struct IOCursor *cursor);
+
+/*
+    Moves the cursor forward by 'bytes', which must not go past the end
+*/
+void iocursor_skip(struct IOCursor *cursor, int bytes);
+
+/*
+    Copies 'bytes' bytes from the cursor position into 'dest', moving the
+    cursor forward. Returns the number of bytes copied, lower than 'bytes'
+    if the segments end first
+*/
+int iocursor_copy(struct IOCursor *cursor, char *dest, int bytes);
+
+/*
+    Describes the next 'bytes' bytes as a list of slices of the segments,
+    written in 'out', moving the cursor forward. At most 'max' slices are
+    written: if they are not enough fewer bytes are taken.
+    Returns the number of slices, 'taken' is set to the bytes they cover
+*/
+int iocursor_slice(struct IOCursor *cursor, int bytes, struct IOVec *out, int max, int *taken);
+
+#endif
@@ -2,8 +2,9 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdarg.h>
-#include <kernel/devices/tty/tty.h>
 #include <kernel/devices/serial/serial.h>
+#include <kernel/gui/console.h>
+#include <klibc/string.h>
 
 /*
     Copies 'str' into 'dest' and returns how many characters have been copied
@@ -154,9 +155,17 @@ int kprintf(char *format, ...)
         kprintf we might have not setup paging yet
     */
     int printed = kvprintf(buffer, format, args);
-    terminal_writestring(buffer);
+    console_write(buffer, strlen(buffer));
     serial_write(buffer);
     va_end(args);
 
     return printed;
-}
\ No newline at end of file
+}
+
+int kwrite(char *data, int count)
+{
+    console_write(data, count);
+    serial_write_bytes(data, count);
+
+    return count;
+}
@@ -3,4 +3,11 @@
 
 int kprintf(char*, ...);
 
+/*
+    Writes 'count' characters from 'data' as they are to the terminal and 
+    to the serial console, without formatting them.
+    Returns the number of characters written
+*/
+int kwrite(char *data, int count);
+
 #endif
\ No newline at end of file
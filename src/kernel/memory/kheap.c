@@ -14,6 +14,9 @@ void *kmalloc(size_t count)
         required_pages++;
     }
     struct PageInfo *page = page_alloc(required_pages);
+    if (page == NULL) {
+        return NULL;
+    }
     struct MallocHeader *head = (struct MallocHeader *) page2addr(page);
     head->magic = MALLOC_MAGIC;
     head->pageInfo = page;
@@ -12,12 +12,17 @@
     [0, 1MB]: Not used, we save all the bios structures
     [1MB, 128MB]: The kernel stuff
     [128MB, 0x8010000 (128MB + 64KB)]: Stack of the currently running process
-    [0x8010000, 4GB]: Available to programs
+    [0x8010000, 0xA0000000]: Available to programs
+    [0xA0000000, 0xE0000000]: Files and shared memory mapped with mmap. 
+    Each address space has its own page tables for this range
+    [0xE0000000, 4GB]: Available to programs
 */
 
 #define KERNEL_END          0x08000000 
 #define USER_STACK_BOTTOM   KERNEL_END
 #define USER_STACK_TOP      0x08010000
+#define MMAP_REGION_START   0xA0000000
+#define MMAP_REGION_END     0xE0000000
 
 #define PROCESS_KERNEL_STACK_SIZE   (64 * 1024)
 
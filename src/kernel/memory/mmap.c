@@ -0,0 +1,280 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <kernel/memory/mmap.h>
+#include <kernel/memory/kheap.h>
+#include <kernel/filesystems/pagecache.h>
+#include <kernel/arch/i386/paging.h>
+#include <kernel/arch/i386/x86.h>
+#include <kernel/process.h>
+#include <klibc/string.h>
+
+
+static struct MemoryMapping mappings[MMAP_MAX_MAPPINGS];
+
+/*
+    Returns a mapping, of any process, that uses part of the 'length' bytes 
+    from 'start'. NULL if there is none
+*/
+static struct MemoryMapping *mmap_overlap(vaddr_t start, uint32_t length)
+{
+    for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+        struct MemoryMapping *m = &mappings[i];
+        if (m->owner != NULL && start < m->start + m->length && m->start < start + length)
+            return m;
+    }
+
+    return NULL;
+}
+
+/*
+    Finds 'length' bytes of the mmap region not used by any mapping. The
+    region is shared between all the processes, so that processes using
+    the same page directory never get the same addresses.
+    Returns the start of the space found, 0 if there is none
+*/
+static vaddr_t mmap_find_space(uint32_t length)
+{
+    vaddr_t start = MMAP_REGION_START;
+    struct MemoryMapping *m;
+    do {
+        if (length > MMAP_REGION_END - start) {
+            return 0;
+        }
+        m = mmap_overlap(start, length);
+        if (m != NULL)
+            start = m->start + m->length;
+    } while (m != NULL);
+
+    return start;
+}
+
+static struct MemoryMapping *mmap_free_slot(void)
+{
+    for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+        if (mappings[i].owner == NULL)
+            return &mappings[i];
+    }
+
+    return NULL;
+}
+
+/*
+    Returns the mapping of 'proc' that contains 'addr', NULL if there is none
+*/
+static struct MemoryMapping *mmap_find(Process *proc, vaddr_t addr)
+{
+    for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+        struct MemoryMapping *m = &mappings[i];
+        if (m->owner == proc && addr >= m->start && addr - m->start < m->length)
+            return m;
+    }
+
+    return NULL;
+}
+
+static void mmap_unmap(struct MemoryMapping *m)
+{
+    for (uint32_t i = 0; i < m->length / PGSIZE; i++) {
+        vaddr_t va = m->start + i * PGSIZE;
+        pte_t *entry = pgdir_addr2entry(m->pgdir, va);
+        if (entry == NULL || !(*entry & PG_PRESENT))
+            continue;
+
+        // The frames of shared regions are freed with the region
+        if (m->shm == NULL && m->pages[i] != NULL) {
+            pagecache_put(m->pages[i]);
+        } else if (m->shm == NULL) {
+            page_free(addr2page((void *) PTE_ADDR(*entry)));
+        }
+        *entry = 0;
+        invlpg(va);
+    }
+
+    if (m->shm != NULL) {
+        shm_put(m->shm);
+    } else {
+        kfclose(m->file);
+        kfree(m->pages);
+    }
+    m->owner = NULL;
+}
+
+vaddr_t kmmap(Process *proc, char *path, uint32_t length, int offset, int prot, int flags)
+{
+    if (length == 0 || length > MMAP_REGION_END - MMAP_REGION_START)
+        return 0;
+    if (offset < 0 || offset % PGSIZE != 0)
+        return 0;
+    if (flags != MMAP_SHARED && flags != MMAP_PRIVATE)
+        return 0;
+    if (flags == MMAP_SHARED && prot & MMAP_PROT_WRITE)
+        return 0;
+
+    struct MemoryMapping *m = mmap_free_slot();
+    if (m == NULL)
+        return 0;
+
+    length = ROUNDUP(length, PGSIZE);
+    vaddr_t start = mmap_find_space(length);
+    if (start == 0)
+        return 0;
+
+    FileDesc file = kfopen(path, "r");
+    if (file == NULL)
+        return 0;
+    size_t pages_size = (length / PGSIZE) * sizeof(struct CachedPage *);
+    struct CachedPage **pages = (struct CachedPage **) kmalloc(pages_size);
+    if (pages == NULL) {
+        kfclose(file);
+        return 0;
+    }
+    memset(pages, 0, pages_size);
+
+    *m = (struct MemoryMapping) {
+        .owner = proc,
+        .pgdir = proc->pgdir,
+        .start = start,
+        .length = length,
+        .file = file,
+        .offset = offset,
+        .prot = prot,
+        .flags = flags,
+        .pages = pages
+    };
+
+    return start;
+}
+
+vaddr_t kshmmap(Process *proc, char *name, vaddr_t addr, int prot)
+{
+    struct MemoryMapping *m = mmap_free_slot();
+    if (m == NULL)
+        return 0;
+    struct SharedRegion *region = shm_get(name);
+    if (region == NULL)
+        return 0;
+
+    if (addr == 0) {
+        addr = mmap_find_space(region->length);
+    } else if (addr % PGSIZE != 0 || addr < MMAP_REGION_START || 
+            region->length > MMAP_REGION_END - addr || 
+            mmap_overlap(addr, region->length) != NULL) {
+        addr = 0;
+    }
+    if (addr == 0) {
+        shm_put(region);
+        return 0;
+    }
+
+    *m = (struct MemoryMapping) {
+        .owner = proc,
+        .pgdir = proc->pgdir,
+        .start = addr,
+        .length = region->length,
+        .prot = prot,
+        .flags = MMAP_SHARED,
+        .shm = region
+    };
+
+    uint32_t flags = PG_PRESENT | PG_USER | (prot & MMAP_PROT_WRITE ? PG_RW : 0);
+    for (uint32_t i = 0; i < region->length / PGSIZE; i++) {
+        vaddr_t va = addr + i * PGSIZE;
+        pte_t *entry = pgdir_walk(m->pgdir, va);
+        if (entry == NULL) {
+            // The pages mapped so far are removed with the mapping
+            mmap_unmap(m);
+            return 0;
+        }
+        *entry = (paddr_t) region->frames[i] | flags;
+        invlpg(va);
+    }
+
+    return addr;
+}
+
+vaddr_t kshmcreate(Process *proc, char *name, uint32_t length, int prot)
+{
+    if (shm_create(name, length) == NULL)
+        return 0;
+
+    vaddr_t addr = kshmmap(proc, name, 0, prot);
+    if (addr == 0) {
+        // Nobody mapped the region, dropping a reference frees it
+        shm_put(shm_get(name));
+    }
+
+    return addr;
+}
+
+int kmunmap(Process *proc, vaddr_t addr)
+{
+    struct MemoryMapping *m = mmap_find(proc, addr);
+    if (m == NULL || m->start != addr) {
+        return -1;
+    }
+    mmap_unmap(m);
+
+    return 0;
+}
+
+void mmap_release_all(Process *proc)
+{
+    for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) {
+        if (mappings[i].owner == proc)
+            mmap_unmap(&mappings[i]);
+    }
+}
+
+int mmap_handle_fault(vaddr_t addr, uint32_t error)
+{
+    struct MemoryMapping *m = mmap_find(get_running_process(), addr);
+    if (m == NULL || (pdir_t) read_cr3() != m->pgdir) {
+        return -1;
+    }
+    // Shared regions are always mapped whole, the access is not allowed
+    if (m->shm != NULL) {
+        return -1;
+    }
+    bool write = error & PF_WRITE;
+    if (write && !(m->prot & MMAP_PROT_WRITE)) {
+        return -1;
+    }
+
+    vaddr_t va = ROUNDDOWN(addr, PGSIZE);
+    int i = (va - m->start) / PGSIZE;
+    pte_t *entry = pgdir_walk(m->pgdir, va);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    if (!(*entry & PG_PRESENT)) {
+        struct CachedPage *page = pagecache_get(m->file, m->offset / PGSIZE + i);
+        if (page == NULL) {
+            return -1;
+        }
+        // Cached pages are always mapped read only, writes need a copy
+        m->pages[i] = page;
+        *entry = (paddr_t) page->addr | PG_PRESENT | PG_USER;
+        invlpg(va);
+        if (!write) {
+            return 0;
+        }
+    }
+
+    // A write to a page of a private mapping that is still the cached one
+    if (m->pages[i] == NULL) {
+        return -1;
+    }
+    struct PageInfo *copy = page_alloc(1);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(page2addr(copy), m->pages[i]->addr, PGSIZE);
+    pagecache_put(m->pages[i]);
+    m->pages[i] = NULL;
+    *entry = (paddr_t) page2addr(copy) | PG_PRESENT | PG_USER | PG_RW;
+    invlpg(va);
+
+    return 0;
+}
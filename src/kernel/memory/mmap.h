@@ -0,0 +1,103 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <stdint.h>
+#include <kernel/process.h>
+#include <kernel/filesystems/vfs.h>
+#include <kernel/filesystems/pagecache.h>
+#include <kernel/memory/shm.h>
+#include <kernel/memory/memory.h>
+
+// How many mappings can exist at the same time, between all processes
+#define MMAP_MAX_MAPPINGS   64
+
+#define MMAP_PROT_READ      0x01
+#define MMAP_PROT_WRITE     0x02
+
+/*
+    Shared mappings use the pages of the page cache directly, so every
+    process mapping the same file sees the same memory. Private mappings do
+    the same until a page is written, at that point the process gets its own
+    copy of that page
+*/
+#define MMAP_SHARED         0x01
+#define MMAP_PRIVATE        0x02
+
+/*
+    A file or a shared memory region mapped in the address space of a 
+    process. Pages of files are filled when they are first accessed, see 
+    mmap_handle_fault, shared regions are mapped whole right away
+*/
+struct MemoryMapping {
+    // The process that created the mapping, NULL if the slot is unused
+    Process *owner;
+    pdir_t pgdir;
+    vaddr_t start;
+    uint32_t length;
+    FileDesc file;
+    // Where the mapping starts in the file, a multiple of PGSIZE
+    int offset;
+    // The shared region mapped instead of a file, NULL for files
+    struct SharedRegion *shm;
+    int prot;
+    int flags;
+    /*
+        pages[i] is the cached page mapped at the i-th page of the mapping,
+        NULL if the page was not accessed yet or if it was replaced by a
+        private copy
+    */
+    struct CachedPage **pages;
+};
+
+/*
+    Maps 'length' bytes of the file at 'path', starting from 'offset', in the
+    address space of 'proc'. The address is chosen in the mmap region.
+    'prot' is a combination of MMAP_PROT_*, 'flags' is either MMAP_SHARED or
+    MMAP_PRIVATE. Shared mappings cannot be writable, as changes are never
+    written back to the file.
+    Returns the address of the mapping, 0 if the arguments are not valid,
+    the file cannot be opened or there is no space left
+*/
+vaddr_t kmmap(Process *proc, char *path, uint32_t length, int offset, int prot, int flags);
+
+/*
+    Maps the whole shared region called 'name' in the address space of 
+    'proc', at 'addr' if it is not 0, otherwise at an address chosen in the 
+    mmap region. 'addr' must be page aligned and the mapping must fit in the 
+    mmap region without overlapping other mappings. 'prot' is a combination 
+    of MMAP_PROT_*.
+    Returns the address of the mapping, 0 if the region doesn't exist, the 
+    address is not valid or there is no space left
+*/
+vaddr_t kshmmap(Process *proc, char *name, vaddr_t addr, int prot);
+
+/*
+    Creates the shared region called 'name', of 'length' bytes, and maps it 
+    in the address space of 'proc' as kshmmap does with 'addr' 0. The region 
+    lives as long as this or other mappings of it, so it is freed at the 
+    latest when the processes that map it exit.
+    Returns the address of the mapping, 0 if the region can't be created or 
+    mapped
+*/
+vaddr_t kshmcreate(Process *proc, char *name, uint32_t length, int prot);
+
+/*
+    Removes the mapping of 'proc' that starts at 'addr', freeing its pages.
+    Returns 0 on success, -1 if there is no mapping at 'addr'
+*/
+int kmunmap(Process *proc, vaddr_t addr);
+
+/*
+    Removes all the mappings of a process, to be called when it is freed
+*/
+void mmap_release_all(Process *proc);
+
+/*
+    Handles a page fault at 'addr' for the running process, 'error' is the
+    error code pushed by the cpu. Fills a page of a mapping that was never
+    accessed, or gives a process its own copy of a page it wrote to.
+    Returns 0 if the fault was handled, -1 if the access is not valid
+*/
+int mmap_handle_fault(vaddr_t addr, uint32_t error);
+
+#endif
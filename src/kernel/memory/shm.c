@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <kernel/memory/shm.h>
+#include <kernel/memory/kheap.h>
+#include <kernel/arch/i386/paging.h>
+#include <kernel/lib/kassert.h>
+#include <klibc/string.h>
+
+
+static struct SharedRegion regions[SHM_MAX_REGIONS];
+
+static struct SharedRegion *shm_find(char *name)
+{
+    for (int i = 0; i < SHM_MAX_REGIONS; i++) {
+        if (regions[i].length != 0 && strcmp(regions[i].name, name) == 0)
+            return &regions[i];
+    }
+
+    return NULL;
+}
+
+static void shm_free_frames(void **frames, int count)
+{
+    for (int i = 0; i < count; i++)
+        page_free(addr2page(frames[i]));
+    kfree(frames);
+}
+
+struct SharedRegion *shm_create(char *name, uint32_t length)
+{
+    if (strlen(name) == 0 || strlen(name) > SHM_NAME_LEN || length == 0)
+        return NULL;
+    if (length > MMAP_REGION_END - MMAP_REGION_START || shm_find(name) != NULL)
+        return NULL;
+
+    struct SharedRegion *region = NULL;
+    for (int i = 0; i < SHM_MAX_REGIONS && region == NULL; i++) {
+        if (regions[i].length == 0)
+            region = &regions[i];
+    }
+    if (region == NULL)
+        return NULL;
+
+    length = ROUNDUP(length, PGSIZE);
+    const int count = length / PGSIZE;
+    void **frames = (void **) kmalloc(count * sizeof(void *));
+    if (frames == NULL)
+        return NULL;
+    // One page at a time, the region doesn't need contiguous memory
+    for (int i = 0; i < count; i++) {
+        struct PageInfo *page = page_alloc(1);
+        if (page == NULL) {
+            shm_free_frames(frames, i);
+            return NULL;
+        }
+        frames[i] = page2addr(page);
+        memset(frames[i], 0, PGSIZE);
+    }
+
+    strcpy(region->name, name);
+    region->length = length;
+    region->refs = 0;
+    region->frames = frames;
+
+    return region;
+}
+
+struct SharedRegion *shm_get(char *name)
+{
+    struct SharedRegion *region = shm_find(name);
+    if (region != NULL)
+        region->refs++;
+
+    return region;
+}
+
+void shm_put(struct SharedRegion *region)
+{
+    kassert(region->refs > 0);
+    region->refs--;
+    if (region->refs > 0)
+        return;
+
+    shm_free_frames(region->frames, region->length / PGSIZE);
+    region->length = 0;
+    region->frames = NULL;
+}
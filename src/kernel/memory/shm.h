@@ -0,0 +1,49 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <kernel/memory/memory.h>
+
+// How many shared memory regions can exist at the same time
+#define SHM_MAX_REGIONS     32
+#define SHM_NAME_LEN        31
+
+/*
+    Memory that more processes can map at the same time, identified by a 
+    name. The frames are allocated when the region is created and are the 
+    same in every mapping, so what a process writes is seen right away by 
+    the others. 'refs' counts the mappings: when the last one is removed 
+    the frames are freed and the name can be used again
+*/
+struct SharedRegion {
+    char name[SHM_NAME_LEN + 1];
+    // The size of the region, a multiple of PGSIZE. 0 if the slot is unused
+    uint32_t length;
+    int refs;
+    // The address of each page of the region
+    void **frames;
+};
+
+/*
+    Creates a zeroed region of 'length' bytes, rounded up to pages, called 
+    'name'. The region is only freed when its last mapping is removed, so it 
+    must be mapped right away: use kshmcreate, which does both.
+    Returns NULL if the name is too long or already used, there are too many 
+    regions or there is no memory for it
+*/
+struct SharedRegion *shm_create(char *name, uint32_t length);
+
+/*
+    Returns the region called 'name' with a reference taken for a new 
+    mapping, NULL if there is none
+*/
+struct SharedRegion *shm_get(char *name);
+
+/*
+    Drops a reference taken with shm_get, freeing the region if it was the 
+    last one
+*/
+void shm_put(struct SharedRegion *region);
+
+#endif
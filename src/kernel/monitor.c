@@ -11,6 +11,7 @@
 #include <klibc/string.h>
 #include <kernel/memory/kheap.h>
 #include <kernel/process.h>
+#include <kernel/ipc/pipe.h>
 #include <kernel/lib/time.h>
 #include <kernel/devices/ide/ide.h>
 
@@ -27,7 +28,10 @@ struct MonitorCommand commands[] = {
     {"echo", "Writes all the argument again", monitor_echo},
     {"ls", "Lists the content of a directory", monitor_ls},
     {"cat", "Prints the content of a file", monitor_cat},
-    {"run", "Runs a program", monitor_run},
+    {"write", "Appends the arguments as a new line at the end of a file", monitor_write},
+    {"rm", "Deletes files", monitor_rm},
+    {"mkdir", "Creates directories", monitor_mkdir},
+    {"run", "Runs programs, 'run a | b' sends the output of a to b", monitor_run},
     {"ps", "Shows all the currently running processes in order of execution", monitor_ps}, 
     {"date", "Shows the current date and time", monitor_date}
 };
@@ -187,19 +191,110 @@ int monitor_cat(int argc, char **args)
     return 0;
 }
 
+int monitor_write(int argc, char **argv)
+{
+    if (argc < 2) {
+        kprintf("usage: write <file> [text...]\n");
+        return -1;
+    }
+
+    FileDesc file = kfopen(argv[1], "a");
+    if (file == NULL) {
+        kprintf("could not open %s\n", argv[1]);
+        return -1;
+    }
+    for (int i = 2; i < argc; i++) {
+        kfwrite(argv[i], strlen(argv[i]), file);
+        kfwrite(i == argc - 1 ? "\n" : " ", 1, file);
+    }
+    if (kfclose(file) != 0) {
+        kprintf("could not save %s\n", argv[1]);
+        return -1;
+    }
+
+    return 0;
+}
+
+int monitor_rm(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (kunlink(argv[i]) != 0) {
+            kprintf("could not delete %s\n", argv[i]);
+        }
+    }
+
+    return 0;
+}
+
+int monitor_mkdir(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (kmkdir(argv[i]) != 0) {
+            kprintf("could not create %s\n", argv[i]);
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Starts the program at 'path' with the argument standard input, output 
+    and error
+*/
+static void monitor_exec(char *path, struct ProcessFile *stdio)
+{
+    FileDesc fd = kfopen(path, "r");
+    if (fd == NULL) {
+        kprintf("could not open %s\n", path);
+        return;
+    }
+    if (execv(path, fd, stdio)) {
+        kprintf("an error happened while opening %s\n", path);
+    }
+    kfclose(fd);
+}
+
+/*
+    Runs each program in the arguments. Programs separated by a '|' are 
+    connected with a pipe: what one writes on its standard output is read 
+    by the next one from its standard input
+*/
 int monitor_run(int argc, char **argv)
 {
+    struct Pipe *input = NULL;
     for (int i = 1; i < argc; i++) {
-        FileDesc fd = kfopen(argv[i], "r");
-        if (fd == NULL) {
-            kprintf("could not open %s", argv[i]);
+        if (strcmp(argv[i], "|") == 0) {
             continue;
         }
-        char *binary = (char *) kmalloc(fd->filesize);
-        kassert(fd->filesize == kfread(binary, fd->filesize, fd));
-        if (execv(argv[i], binary)) {
-            kprintf("an error happened while opening %s\n", argv[i]);
+
+        struct Pipe *output = NULL;
+        if (i + 2 < argc && strcmp(argv[i + 1], "|") == 0) {
+            output = pipe_create();
+            if (output == NULL) {
+                kprintf("could not create a pipe for %s\n", argv[i]);
+            }
+        }
+        struct ProcessFile stdio[3] = {
+            { .type = FD_TYPE_TERMINAL }, 
+            { .type = FD_TYPE_TERMINAL }, 
+            { .type = FD_TYPE_TERMINAL }
+        };
+        if (input != NULL) {
+            stdio[STDIN_FILENO] = (struct ProcessFile) { .type = FD_TYPE_PIPE_READ, .pipe = input };
+        }
+        if (output != NULL) {
+            stdio[STDOUT_FILENO] = (struct ProcessFile) { .type = FD_TYPE_PIPE_WRITE, .pipe = output };
+        }
+        monitor_exec(argv[i], stdio);
+
+        // The programs took their own references, the monitor doesn't use the pipes
+        if (input != NULL) {
+            pipe_close(input, PIPE_END_READ);
+        }
+        if (output != NULL) {
+            pipe_close(output, PIPE_END_WRITE);
         }
+        input = output;
     }
 
     return 0;
@@ -16,6 +16,9 @@ int monitor_system(int, char **);
 int monitor_echo(int, char **);
 int monitor_ls(int, char **);
 int monitor_cat(int, char **);
+int monitor_write(int, char **);
+int monitor_rm(int, char **);
+int monitor_mkdir(int, char **);
 int monitor_run(int, char **);
 int monitor_ps(int argc, char **argv);
 int monitor_date(int, char **);
@@ -7,6 +7,10 @@
 #include <kernel/arch/i386/x86.h>
 #include <kernel/lib/kassert.h>
 #include <kernel/elf.h>
+#include <kernel/filesystems/vfs.h>
+#include <kernel/memory/mmap.h>
+#include <kernel/ipc/pipe.h>
+#include <kernel/ipc/ipc.h>
 #include <klibc/string.h>
 #include <kernel/process.h>
 
@@ -35,45 +39,53 @@ static void region_alloc(pdir_t pgdir, vaddr_t vaddr, size_t count)
 
 /*
     Loads an ELF file, allocating and mapping memory in the argument page 
-    directory. 
+    directory. Each segment is read from the file straight to where it 
+    goes in memory, the file is never copied whole.
     Returns the entry point of the program on success, 0 if the file is not an 
-    ELF file
+    ELF file or is shorter than its headers say
 */
-static uint32_t load_elf(pdir_t pagedir, char *binary) 
+static uint32_t load_elf(pdir_t pagedir, FileDesc file) 
 {
-    ELFHeader *head = (ELFHeader *) binary;
-    if (head->magic != ELF_MAGIC) {
+    ELFHeader head;
+    if (kpread(file, (char *) &head, sizeof(head), 0) != sizeof(head) || 
+            head.magic != ELF_MAGIC) {
         return 0;
     }
 
-    ELFProgHeader *prog = (ELFProgHeader *) (binary + head->progHeader);
-    for (size_t i = 0; i < head->progEntries; i++) {
-        if (prog[i].type == ELF_PROG_LOAD) {
+    for (size_t i = 0; i < head.progEntries; i++) {
+        ELFProgHeader prog;
+        int offset = head.progHeader + i * head.progEntrySize;
+        if (kpread(file, (char *) &prog, sizeof(prog), offset) != sizeof(prog)) {
+            return 0;
+        }
+        if (prog.type == ELF_PROG_LOAD) {
+            if (prog.fileSize > prog.memSize) {
+                return 0;
+            }
             region_alloc(
                 pagedir, 
-                prog[i].vAddr, 
-                prog[i].memSize
-            );
-            memcpy(
-                (void *) prog[i].vAddr, 
-                (void *) (binary + prog[i].dataOffset), 
-                prog[i].
-                fileSize
+                prog.vAddr, 
+                prog.memSize
             );
+            // A truncated file would leave the program half loaded
+            int read = kpread(file, (char *) prog.vAddr, prog.fileSize, prog.dataOffset);
+            if (read < 0 || (uint32_t) read != prog.fileSize) {
+                return 0;
+            }
             /*
                 The filesize can be less than the size in memory. As such we 
                 need to set to 0 all the bytes after the end of filesize, 
                 since they contain thrash anyway
             */
             memset(
-                (void *) (prog[i].vAddr + prog[i].fileSize), 
+                (void *) (prog.vAddr + prog.fileSize), 
                 0, 
-                prog[i].memSize - prog[i].fileSize
+                prog.memSize - prog.fileSize
             );
         }
     }
 
-    return head->entry;
+    return head.entry;
 }
 
 
@@ -98,7 +110,87 @@ static Process *find_free_process(void)
     return NULL;
 }
 
-int process_create(char *name, uint32_t entryPoint, pdir_t pagedir)
+/*
+    Empties the descriptor table of a process, except for the standard input, 
+    output and error which are copied from 'stdio', or refer to the terminal 
+    if it is NULL
+*/
+static void process_fd_init(Process *proc, struct ProcessFile *stdio)
+{
+    for (int i = 0; i < PROCESS_MAX_FILES; i++) {
+        proc->files[i].type = FD_TYPE_UNUSED;
+        proc->files[i].file = NULL;
+    }
+    for (int i = STDIN_FILENO; i <= STDERR_FILENO; i++) {
+        if (stdio == NULL) {
+            proc->files[i].type = FD_TYPE_TERMINAL;
+            continue;
+        }
+        proc->files[i] = stdio[i];
+        switch (stdio[i].type) {
+        case FD_TYPE_PIPE_READ:
+            pipe_open(stdio[i].pipe, PIPE_END_READ);
+            break;
+        case FD_TYPE_PIPE_WRITE:
+            pipe_open(stdio[i].pipe, PIPE_END_WRITE);
+            break;
+        default:
+            kassert(stdio[i].type == FD_TYPE_TERMINAL);
+        }
+    }
+}
+
+int process_fd_alloc(Process *proc, int type, void *object)
+{
+    for (int i = 0; i < PROCESS_MAX_FILES; i++) {
+        if (proc->files[i].type == FD_TYPE_UNUSED) {
+            proc->files[i].type = type;
+            proc->files[i].file = (FileDesc) object;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+struct ProcessFile *process_fd_get(Process *proc, int fd)
+{
+    if (fd < 0 || fd >= PROCESS_MAX_FILES || proc->files[fd].type == FD_TYPE_UNUSED) {
+        return NULL;
+    }
+
+    return &proc->files[fd];
+}
+
+int process_fd_close(Process *proc, int fd)
+{
+    struct ProcessFile *entry = process_fd_get(proc, fd);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    switch (entry->type) {
+    case FD_TYPE_FILE:
+        kfclose(entry->file);
+        break;
+    case FD_TYPE_DIR:
+        kclosedir(entry->dir);
+        kfree(entry->dir);
+        break;
+    case FD_TYPE_PIPE_READ:
+        pipe_close(entry->pipe, PIPE_END_READ);
+        break;
+    case FD_TYPE_PIPE_WRITE:
+        pipe_close(entry->pipe, PIPE_END_WRITE);
+        break;
+    }
+    entry->type = FD_TYPE_UNUSED;
+    entry->file = NULL;
+
+    return 0;
+}
+
+int process_create(char *name, uint32_t entryPoint, pdir_t pagedir, struct ProcessFile *stdio)
 {
     Process *p = find_free_process();
     if (p == NULL) {
@@ -113,6 +205,9 @@ int process_create(char *name, uint32_t entryPoint, pdir_t pagedir)
     p->state = PROC_STATE_READY;
     p->pgdir = pagedir;
     p->pid = get_next_pid();
+    p->waitChannel = NULL;
+    p->ipcNext = NULL;
+    p->ipcReplyTo = NULL;
 
     char *stack = (char *) kmalloc(PROCESS_KERNEL_STACK_SIZE);
     if (stack == NULL) {
@@ -134,6 +229,8 @@ int process_create(char *name, uint32_t entryPoint, pdir_t pagedir)
 
     p->registers.esp -= 16;
     p->registers.ebp = p->registers.esp;
+    // Only now that nothing can fail, so that the pipes are never left open
+    process_fd_init(p, stdio);
 
     p->next = running_proc->next;
     running_proc->next = p;
@@ -146,11 +243,38 @@ void process_set_dead(Process *proc)
     proc->state = PROC_STATE_DEAD;
 }
 
+void process_wait(void *channel)
+{
+    running_proc->state = PROC_STATE_WAITING;
+    running_proc->waitChannel = channel;
+}
+
+void process_wakeup(void *channel)
+{
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (processes[i].state == PROC_STATE_WAITING && processes[i].waitChannel == channel) {
+            processes[i].state = PROC_STATE_READY;
+            processes[i].waitChannel = NULL;
+        }
+    }
+}
+
 Process *get_running_process(void)
 {
     return running_proc;
 }
 
+Process *process_find(int pid)
+{
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (processes[i].state != PROC_STATE_UNUSED && 
+                processes[i].state != PROC_STATE_DEAD && processes[i].pid == pid)
+            return &processes[i];
+    }
+
+    return NULL;
+}
+
 /*
     Frees a process resources. This function should not be called unless you 
     are sure the process is not in the free list and it is not being executed. 
@@ -159,13 +283,18 @@ Process *get_running_process(void)
 static void process_free(Process *proc)
 {
     proc->state = PROC_STATE_UNUSED;
+    mmap_release_all(proc);
+    ipc_release(proc);
+    for (int i = 0; i < PROCESS_MAX_FILES; i++) {
+        process_fd_close(proc, i);
+    }
     // TODO: Free the memory used by the code, stack & heap
     // if (proc->pgdir != paging_kernel_pgdir()) {
     //     pgdir_free(proc->pgdir);
     // }
 }
 
-int execv(char *name, char *binary)
+int execv(char *name, FileDesc file, struct ProcessFile *stdio)
 {
     /*
         load_elf needs to write directly to the specific memory addresses 
@@ -177,7 +306,7 @@ int execv(char *name, char *binary)
     pdir_t pagedir = pgdir_create();
     pdir_t current_pagedir = (pdir_t) read_cr3();
     paging_load(pagedir);
-    uint32_t entry = load_elf(pagedir, binary);
+    uint32_t entry = load_elf(pagedir, file);
     paging_load(current_pagedir);
 
     if (entry == 0) {
@@ -185,7 +314,7 @@ int execv(char *name, char *binary)
         return E_NOTELF;
     }
 
-    int result = process_create(name, entry, pagedir);
+    int result = process_create(name, entry, pagedir, stdio);
     if (result < 0) {
         // TODO: Destroy pagedir
     }
@@ -200,6 +329,10 @@ void scheduler_init(void)
     p->state = PROC_STATE_RUNNING;
     p->pid = get_next_pid();
     p->pgdir = paging_kernel_pgdir();
+    p->waitChannel = NULL;
+    p->ipcNext = NULL;
+    p->ipcReplyTo = NULL;
+    process_fd_init(p, NULL);
     p->next = p;
     p->name = "Monitor";
     running_proc = p;
@@ -220,21 +353,39 @@ void scheduler(struct intframe_t *frame)
         return;
     }
 
-    // Simple round robin, inefficient but works for now
+    /*
+        Simple round robin, inefficient but works for now. Dead processes 
+        are removed from the list, waiting ones are skipped
+    */
     Process *old = running_proc;
+    Process *prev = old;
     Process *new = old->next;
-    while (new->state == PROC_STATE_DEAD) {
-        Process *new_next = new->next;
-        process_free(new);
-        new = new_next;
+    while (new != old && new->state != PROC_STATE_READY) {
+        if (new->state == PROC_STATE_DEAD) {
+            prev->next = new->next;
+            process_free(new);
+        } else {
+            prev = new;
+        }
+        new = prev->next;
+    }
+    if (new == old) {
+        // The monitor never waits, so at least it can always run
+        kassert(old->state == PROC_STATE_RUNNING);
+        return;
     }
 
-    old->next = new;
-    // The process might be dead, without this check we would revive it
+    scheduler_switch(frame, new);
+}
+
+void scheduler_switch(struct intframe_t *frame, Process *next)
+{
+    Process *old = running_proc;
+    // The process might be dead or waiting, without this check we would revive it
     if (old->state == PROC_STATE_RUNNING) {
         old->state = PROC_STATE_READY;
     }
-    new->state = PROC_STATE_RUNNING;
+    next->state = PROC_STATE_RUNNING;
 
     // Save the running process registers
     old->registers.edi = frame->edi;
@@ -248,18 +399,18 @@ void scheduler(struct intframe_t *frame)
     old->registers.esp = frame->curresp;
 
     // Restore the newly running process's ones
-    frame->edi = new->registers.edi;
-    frame->esi = new->registers.esi;
-    frame->ebp = new->registers.ebp;
-    frame->ebx = new->registers.ebx;
-    frame->edx = new->registers.edx;
-    frame->ecx = new->registers.ecx;
-    frame->eax = new->registers.eax;
-
-    frame->curresp = new->registers.esp;
+    frame->edi = next->registers.edi;
+    frame->esi = next->registers.esi;
+    frame->ebp = next->registers.ebp;
+    frame->ebx = next->registers.ebx;
+    frame->edx = next->registers.edx;
+    frame->ecx = next->registers.ecx;
+    frame->eax = next->registers.eax;
+
+    frame->curresp = next->registers.esp;
     
-    running_proc = new;
-    if (old->pgdir != new->pgdir) {
-        paging_load(new->pgdir);
+    running_proc = next;
+    if (old->pgdir != next->pgdir) {
+        paging_load(next->pgdir);
     }
 }
\ No newline at end of file
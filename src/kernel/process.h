@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <kernel/arch/i386/boot/descriptor_tables.h>
 #include <kernel/arch/i386/paging.h>
+#include <kernel/filesystems/vfs.h>
+#include <kernel/ipc/ipc.h>
 
 #define MAX_PROCESSES       16
 
@@ -15,6 +17,23 @@
 
 #define PROCESS_KERNEL_STACK_SIZE   (64 * 1024)
 
+// How many files a process can have open at the same time
+#define PROCESS_MAX_FILES   16
+
+#define STDIN_FILENO        0
+#define STDOUT_FILENO       1
+#define STDERR_FILENO       2
+
+/*
+    What a file descriptor of a process refers to
+*/
+#define FD_TYPE_UNUSED      0
+#define FD_TYPE_TERMINAL    1
+#define FD_TYPE_FILE        2
+#define FD_TYPE_DIR         3
+#define FD_TYPE_PIPE_READ   4
+#define FD_TYPE_PIPE_WRITE  5
+
 #define E_PROCESSLIMITREACHED   1
 #define E_OUTOFMEMORY           2
 #define E_NOTELF                3
@@ -29,12 +48,40 @@ struct X86Registers {
     uint32_t esp;
 };
 
+struct Pipe;
+
+/*
+    An entry of the file descriptor table of a process. The descriptor is 
+    the index of the entry in the table
+*/
+struct ProcessFile {
+    int type;
+    union {
+        FileDesc file;
+        Dir *dir;
+        struct Pipe *pipe;
+    };
+};
+
 typedef struct Process {
     struct X86Registers registers;
     pdir_t pgdir;
+    struct ProcessFile files[PROCESS_MAX_FILES];
     
     int pid;
     int state;
+    // What the process is waiting for when in PROC_STATE_WAITING
+    void *waitChannel;
+    /*
+        Used by the IPC system calls: the message of the process while it 
+        waits to send it, whether it then waits for a reply, the next 
+        process waiting on the same endpoint and the caller this process 
+        has to reply to
+    */
+    struct IPCMessage ipcMessage;
+    bool ipcCall;
+    struct Process *ipcNext;
+    struct Process *ipcReplyTo;
     char *name;
     struct Process *next;
 } Process;
@@ -55,12 +102,16 @@ void scheduler_init(void);
     @param pagedir: The page directory that needs to be loaded when the 
     process runs. This does NOT get copied, it is your responsability to not 
     free it until the process is dead
+    @param stdio: The standard input, output and error of the process, only 
+    the terminal and pipes can be used. The pipes get a new reference, so 
+    the caller still has to close its own. NULL to use the terminal for all 
+    of them
     @returns 0 on success, otherwise one of these:
         1. E_OUTOFMEMORY: There is not enough memory to run the program
         2. E_PROCESSLIMIT: The maximum amount of processes running has been 
         reached. 
 */
-int process_create(char *name, uint32_t entryPoint, pdir_t pagedir);
+int process_create(char *name, uint32_t entryPoint, pdir_t pagedir, struct ProcessFile *stdio);
 
 /*
     Sets the process state as dead. This means this process will not be 
@@ -69,6 +120,37 @@ int process_create(char *name, uint32_t entryPoint, pdir_t pagedir);
 */
 void process_set_dead(Process *proc);
 
+/*
+    Puts the running process to sleep until process_wakeup is called with 
+    the same 'channel'. Only to be called from a system call: when the 
+    process is woken up it makes the same system call again
+*/
+void process_wait(void *channel);
+
+/*
+    Makes all the processes waiting on 'channel' ready to run again
+*/
+void process_wakeup(void *channel);
+
+/*
+    Puts a file, a directory or a pipe end in the first free entry of the descriptor 
+    table of the process.
+    Returns the descriptor on success, -1 if the table is full
+*/
+int process_fd_alloc(Process *proc, int type, void *object);
+
+/*
+    Returns the entry of the descriptor table for 'fd', NULL if 'fd' is not 
+    a valid descriptor or is not open
+*/
+struct ProcessFile *process_fd_get(Process *proc, int fd);
+
+/*
+    Closes a descriptor, closing the file, directory or pipe end it refers to.
+    Returns 0 on success, -1 if 'fd' is not open
+*/
+int process_fd_close(Process *proc, int fd);
+
 /*
     Returns the currently running process. Note that this changes with time, 
     so it might not be valid for all the time you need. Be sure to be in code 
@@ -76,17 +158,26 @@ void process_set_dead(Process *proc);
 */
 Process *get_running_process(void);
 
+/*
+    Returns the process with the given pid, NULL if there is none or it is 
+    dead
+*/
+Process *process_find(int pid);
+
 /*
     Starts a new process from a program stored on disk.
     @param name: The name of the process.
-    @param binary: Where in memory the binary ELF image to load is stored
+    @param file: The ELF image to load, opened for reading. It is not 
+    closed
+    @param stdio: The standard input, output and error of the process, see 
+    process_create
     @returns 0 on success, otherwise one of these:
         1. E_NOTELF: The file opened is not an ELF image
         2. E_OUTOFMEMORY: There is not enough memory to run the program
         3. E_PROCESSLIMIT: The maximum amount of processes running has been 
         reached. 
 */
-int execv(char *name, char *binary);
+int execv(char *name, FileDesc file, struct ProcessFile *stdio);
 
 /*
     Do NOT call this function outside the interrupt handler. This executes one 
@@ -95,4 +186,11 @@ int execv(char *name, char *binary);
 */
 void scheduler(struct intframe_t *frame);
 
+/*
+    Do NOT call this function outside the interrupt handler. Switches from 
+    the running process to 'next' right away, skipping the round robin. The 
+    running process stays waiting if it was, otherwise it becomes ready
+*/
+void scheduler_switch(struct intframe_t *frame, Process *next);
+
 #endif
\ No newline at end of file
@@ -3,7 +3,18 @@
 #include <stdint.h>
 #include <kernel/process.h>
 #include <kernel/syscall.h>
+#include <kernel/memory/mmap.h>
+#include <kernel/memory/shm.h>
+#include <kernel/memory/kheap.h>
+#include <kernel/filesystems/vfs.h>
+#include <kernel/ipc/pipe.h>
+#include <kernel/ipc/ipc.h>
+#include <kernel/devices/ps2kb/keyboard.h>
+#include <kernel/devices/timer/timer.h>
+#include <kernel/lib/util.h>
 #include <kernel/lib/kassert.h>
+#include <kernel/lib/kprintf.h>
+#include <kernel/lib/iovec.h>
 #include <klibc/string.h>
 
 
@@ -16,25 +27,344 @@ static int SYS_exit(uint32_t exitcode)
     return 0;
 }
 
-static int SYS_write(uint32_t filedesc, uint32_t string, uint32_t length)
+/*
+    Takes the characters typed on the keyboard that were not read yet, up to 
+    'count'. This does not wait for input: if nothing was typed 0 is returned
+*/
+static int terminal_read_chars(char *buffer, int count)
 {
-    /*
-        Filedesc is useless for now, but it might be useful if we implement 
-        stdout as a file
-    */
-    kassert(filedesc == 1);
-    char buffer[length+1];
-    memcpy(buffer, (char *) string, length);
-    buffer[length] = '\0';
-    kprintf("%s", buffer);
+    int read = 0;
+    struct KeyAction action;
+    while (read < count && kbd_get_keyaction(&action)) {
+        if (action.pressed && action.character != 0)
+            buffer[read++] = action.character;
+    }
+
+    return read;
+}
+
+/*
+    Reads from a pipe what is in it, up to the length of the segments. If 
+    the pipe is empty the process waits for a writer, unless the write end 
+    is closed: then 0 is returned, as the stream is over
+*/
+static int pipe_read_or_wait(struct Pipe *pipe, struct IOVec *iov, int count)
+{
+    int read = pipe_readv(pipe, iov, count);
+    if (read == 0 && iovec_length(iov, count) > 0 && pipe->writers > 0) {
+        process_wait(pipe);
+    }
+
+    return read;
+}
+
+/*
+    Writes in a pipe as much of the segments as it fits. If the pipe is full 
+    the process waits for a reader. Returns -1 if the read end is closed
+*/
+static int pipe_write_or_wait(struct Pipe *pipe, struct IOVec *iov, int count)
+{
+    if (pipe->readers == 0) {
+        return -1;
+    }
+    int written = pipe_writev(pipe, iov, count);
+    if (written == 0 && iovec_length(iov, count) > 0) {
+        process_wait(pipe);
+    }
+
+    return written;
+}
+
+static int SYS_write(uint32_t filedesc, uint32_t buffer, uint32_t length)
+{
+    struct ProcessFile *entry = process_fd_get(get_running_process(), filedesc);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    switch (entry->type) {
+    case FD_TYPE_TERMINAL:
+        return kwrite((char *) buffer, length);
+    case FD_TYPE_FILE:
+        return kfwrite((char *) buffer, length, entry->file);
+    case FD_TYPE_PIPE_WRITE: {
+        struct IOVec segment = { .base = (char *) buffer, .length = length };
+        return pipe_write_or_wait(entry->pipe, &segment, 1);
+    }
+    default:
+        return -1;
+    }
+}
+
+static int SYS_read(uint32_t filedesc, uint32_t buffer, uint32_t length)
+{
+    struct ProcessFile *entry = process_fd_get(get_running_process(), filedesc);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    switch (entry->type) {
+    case FD_TYPE_TERMINAL:
+        return terminal_read_chars((char *) buffer, length);
+    case FD_TYPE_FILE:
+        return kfread((char *) buffer, length, entry->file);
+    case FD_TYPE_PIPE_READ: {
+        struct IOVec segment = { .base = (char *) buffer, .length = length };
+        return pipe_read_or_wait(entry->pipe, &segment, 1);
+    }
+    default:
+        return -1;
+    }
+}
+
+/*
+    Checks the segments passed to SYS_READV and SYS_WRITEV once, before any 
+    of them is used: there must be at most IOV_MAX of them, each with a 
+    valid address and a non-negative length, and their total length must 
+    fit in the return value.
+    Returns true if the list can be used
+*/
+static bool iovec_validate(struct IOVec *iov, uint32_t count)
+{
+    if (count > IOV_MAX || (count > 0 && iov == NULL)) {
+        return false;
+    }
+
+    int total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (iov[i].length < 0 || (iov[i].length > 0 && iov[i].base == NULL)) {
+            return false;
+        }
+        if (iov[i].length > INT32_MAX - total) {
+            return false;
+        }
+        total += iov[i].length;
+    }
+
+    return true;
+}
+
+static int SYS_writev(uint32_t filedesc, uint32_t iov, uint32_t count)
+{
+    struct ProcessFile *entry = process_fd_get(get_running_process(), filedesc);
+    struct IOVec *segments = (struct IOVec *) iov;
+    if (entry == NULL || !iovec_validate(segments, count)) {
+        return -1;
+    }
+
+    switch (entry->type) {
+    case FD_TYPE_TERMINAL: {
+        int written = 0;
+        for (uint32_t i = 0; i < count; i++)
+            written += kwrite(segments[i].base, segments[i].length);
+        return written;
+    }
+    case FD_TYPE_FILE:
+        return kfwritev(entry->file, segments, count);
+    case FD_TYPE_PIPE_WRITE:
+        return pipe_write_or_wait(entry->pipe, segments, count);
+    default:
+        return -1;
+    }
+}
+
+static int SYS_readv(uint32_t filedesc, uint32_t iov, uint32_t count)
+{
+    struct ProcessFile *entry = process_fd_get(get_running_process(), filedesc);
+    struct IOVec *segments = (struct IOVec *) iov;
+    if (entry == NULL || !iovec_validate(segments, count)) {
+        return -1;
+    }
+
+    switch (entry->type) {
+    case FD_TYPE_TERMINAL: {
+        int read = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            int result = terminal_read_chars(segments[i].base, segments[i].length);
+            read += result;
+            if (result < segments[i].length)
+                break;
+        }
+        return read;
+    }
+    case FD_TYPE_FILE:
+        return kfreadv(entry->file, segments, count);
+    case FD_TYPE_PIPE_READ:
+        return pipe_read_or_wait(entry->pipe, segments, count);
+    default:
+        return -1;
+    }
+}
+
+/*
+    Opens a file with a kfopen mode string. Directories can only be opened 
+    with "r", the descriptor can then be used with SYS_READDIR
+*/
+static int SYS_open(uint32_t path, uint32_t mode)
+{
+    Process *proc = get_running_process();
+    // Some file systems can open a directory as a file, so directories go first
+    if (!strcmp((char *) mode, "r")) {
+        Dir *dir = (Dir *) kmalloc(sizeof(Dir));
+        if (dir == NULL) {
+            return -1;
+        }
+        if (kopendir((char *) path, dir) == 0) {
+            int fd = process_fd_alloc(proc, FD_TYPE_DIR, dir);
+            if (fd < 0) {
+                kclosedir(dir);
+                kfree(dir);
+            }
+            return fd;
+        }
+        kfree(dir);
+    }
+
+    FileDesc file = kfopen((char *) path, (char *) mode);
+    if (file == NULL) {
+        return -1;
+    }
+    int fd = process_fd_alloc(proc, FD_TYPE_FILE, file);
+    if (fd < 0) {
+        kfclose(file);
+    }
+
+    return fd;
+}
+
+static int SYS_close(uint32_t filedesc)
+{
+    return process_fd_close(get_running_process(), filedesc);
+}
+
+static int SYS_seek(uint32_t filedesc, uint32_t offset, uint32_t whence)
+{
+    struct ProcessFile *entry = process_fd_get(get_running_process(), filedesc);
+    if (entry == NULL || entry->type != FD_TYPE_FILE) {
+        return -1;
+    }
+
+    return kfseek(entry->file, (int) offset, whence);
+}
+
+static int SYS_stat(uint32_t path, uint32_t stat)
+{
+    struct Stat *out = (struct Stat *) stat;
+    Dir dir;
+    if (kopendir((char *) path, &dir) == 0) {
+        kclosedir(&dir);
+        out->type = DIRECTORY;
+        out->size = 0;
+        return 0;
+    }
+
+    FileDesc file = kfopen((char *) path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    out->type = FILE;
+    out->size = file->filesize;
+    kfclose(file);
 
     return 0;
 }
 
+/*
+    Reads the next entry of an open directory. Returns 1 if an entry was 
+    read, 0 if there are no more entries
+*/
+static int SYS_readdir(uint32_t filedesc, uint32_t dirent)
+{
+    struct ProcessFile *entry = process_fd_get(get_running_process(), filedesc);
+    if (entry == NULL || entry->type != FD_TYPE_DIR) {
+        return -1;
+    }
+
+    DirEntry dir_entry;
+    if (klistdir(entry->dir, &dir_entry) == 0) {
+        return 0;
+    }
+    struct Dirent *out = (struct Dirent *) dirent;
+    strcpy(out->name, (char *) dir_entry.name);
+    out->type = dir_entry.type;
+
+    return 1;
+}
+
+/*
+    Creates a pipe, writing the descriptor of its read end and the one of 
+    its write end in the array of 2 integers at 'fds'
+*/
+static int SYS_pipe(uint32_t fds)
+{
+    Process *proc = get_running_process();
+    struct Pipe *pipe = pipe_create();
+    if (pipe == NULL) {
+        return -1;
+    }
+
+    int read_fd = process_fd_alloc(proc, FD_TYPE_PIPE_READ, pipe);
+    if (read_fd < 0) {
+        pipe_close(pipe, PIPE_END_READ);
+        pipe_close(pipe, PIPE_END_WRITE);
+        return -1;
+    }
+    int write_fd = process_fd_alloc(proc, FD_TYPE_PIPE_WRITE, pipe);
+    if (write_fd < 0) {
+        process_fd_close(proc, read_fd);
+        pipe_close(pipe, PIPE_END_WRITE);
+        return -1;
+    }
+    ((int *) fds)[0] = read_fd;
+    ((int *) fds)[1] = write_fd;
+
+    return 0;
+}
+
+static int SYS_mmap(uint32_t path, uint32_t length, uint32_t offset, uint32_t prot, uint32_t flags)
+{
+    return kmmap(get_running_process(), (char *) path, length, offset, prot, flags);
+}
+
+static int SYS_munmap(uint32_t addr)
+{
+    return kmunmap(get_running_process(), addr);
+}
+
+static int SYS_shmcreate(uint32_t name, uint32_t length, uint32_t prot)
+{
+    return kshmcreate(get_running_process(), (char *) name, length, prot);
+}
+
+static int SYS_shmmap(uint32_t name, uint32_t addr, uint32_t prot)
+{
+    return kshmmap(get_running_process(), (char *) name, addr, prot);
+}
+
+static int SYS_ipc_create(uint32_t name)
+{
+    return ipc_endpoint_create(get_running_process(), (char *) name);
+}
+
+static int SYS_ipc_lookup(uint32_t name)
+{
+    return ipc_endpoint_lookup((char *) name);
+}
+
+/*
+    Waits until the tick count reaches 'tick', then returns the tick count. 
+    Waiting restarts the call at every tick, so the argument is a point in 
+    time and not a duration
+*/
+static int SYS_sleep(uint32_t tick)
+{
+    timer_wait_until(tick);
+
+    return timer_get_ticks();
+}
+
 int syscall(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx, uint32_t esi, uint32_t edi)
 {
-    (void) esi;
-    (void) edi;
     switch(eax) {
     case SYS_EXIT:
         return SYS_exit(ebx);
@@ -42,6 +372,38 @@ int syscall(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx, uint32_t esi
         return SYS_write(ebx, ecx, edx);
     case SYS_YIELD:
         return 0;
+    case SYS_MMAP:
+        return SYS_mmap(ebx, ecx, edx, esi, edi);
+    case SYS_MUNMAP:
+        return SYS_munmap(ebx);
+    case SYS_OPEN:
+        return SYS_open(ebx, ecx);
+    case SYS_READ:
+        return SYS_read(ebx, ecx, edx);
+    case SYS_CLOSE:
+        return SYS_close(ebx);
+    case SYS_SEEK:
+        return SYS_seek(ebx, ecx, edx);
+    case SYS_STAT:
+        return SYS_stat(ebx, ecx);
+    case SYS_READDIR:
+        return SYS_readdir(ebx, ecx);
+    case SYS_READV:
+        return SYS_readv(ebx, ecx, edx);
+    case SYS_WRITEV:
+        return SYS_writev(ebx, ecx, edx);
+    case SYS_PIPE:
+        return SYS_pipe(ebx);
+    case SYS_SHMCREATE:
+        return SYS_shmcreate(ebx, ecx, edx);
+    case SYS_SHMMAP:
+        return SYS_shmmap(ebx, ecx, edx);
+    case SYS_IPC_CREATE:
+        return SYS_ipc_create(ebx);
+    case SYS_IPC_LOOKUP:
+        return SYS_ipc_lookup(ebx);
+    case SYS_SLEEP:
+        return SYS_sleep(ebx);
     default:
         return 0;
     }
@@ -2,6 +2,7 @@
 #define SYSCALL_H
 
 #include <stdint.h>
+#include <kernel/filesystems/vfs.h>
 
 /*
     Dispatches to the correct system calls. The dispatching is done according 
@@ -12,10 +13,55 @@
 */
 int syscall(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx, uint32_t esi, uint32_t edi);
 
+// The size of the 'int $0x80' instruction, to make a system call again
+#define SYSCALL_INSTRUCTION_SIZE 2
+
 enum {
     SYS_EXIT = 1, 
     SYS_WRITE, 
-    SYS_YIELD
+    SYS_YIELD, 
+    SYS_MMAP, 
+    SYS_MUNMAP, 
+    SYS_OPEN, 
+    SYS_READ, 
+    SYS_CLOSE, 
+    SYS_SEEK, 
+    SYS_STAT, 
+    SYS_READDIR, 
+    SYS_READV, 
+    SYS_WRITEV, 
+    SYS_PIPE, 
+    SYS_SHMCREATE, 
+    SYS_SHMMAP, 
+    SYS_IPC_CREATE, 
+    SYS_IPC_LOOKUP, 
+    // These are handled by ipc_syscall, see ipc.h
+    SYS_IPC_SEND, 
+    SYS_IPC_CALL, 
+    SYS_IPC_RECEIVE, 
+    SYS_IPC_REPLY, 
+    SYS_IPC_REPLYRECEIVE, 
+    SYS_SLEEP
+};
+
+// The maximum number of segments accepted by SYS_READV and SYS_WRITEV
+#define IOV_MAX 64
+
+/*
+    Filled by SYS_STAT. 'type' is 0 for files and 1 for directories, as in 
+    enum DirEntryType
+*/
+struct Stat {
+    int type;
+    int size;
+};
+
+/*
+    Filled by SYS_READDIR, one for each entry of the directory
+*/
+struct Dirent {
+    char name[VFS_NAME_LEN + 1];
+    int type;
 };
 
 #endif
\ No newline at end of file
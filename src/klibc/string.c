@@ -14,12 +14,13 @@ size_t strlen(const char* str)
 
 int strcmp(const char *a, const char *b)
 {
-    while (*a && *b && *a++ == *b++) {
-        ;
+    while (*a && *a == *b) {
+        a++;
+        b++;
     }
-    if (*a == '\0' && *b == '\0')
+    if (*a == *b)
         return 0;
-    else if (*a - *b < 0)
+    else if ((unsigned char) *a < (unsigned char) *b)
         return -1;
     else
         return +1;
@@ -49,13 +50,32 @@ void *memset(void *str, int c, size_t n)
     return str;
 }
 
+/*
+    Copies 4 bytes at a time with 'rep movsl', then the remaining 0-3 bytes 
+    with 'rep movsb'
+*/
 void *memcpy(void *str1, const void *str2, size_t n)
 {
-    char *s1 = (char *) str1;
-    char *s2 = (char *) str2;
+    void *dst = str1;
+    const void *src = str2;
+    size_t dwords = n / 4;
+    size_t bytes = n % 4;
+    asm volatile("rep movsl" 
+        : "+D"(dst), "+S"(src), "+c"(dwords) : : "memory");
+    asm volatile("rep movsb" 
+        : "+D"(dst), "+S"(src), "+c"(bytes) : : "memory");
+
+    return str1;
+}
+
+int memcmp(const void *str1, const void *str2, size_t n)
+{
+    const unsigned char *s1 = (const unsigned char *) str1;
+    const unsigned char *s2 = (const unsigned char *) str2;
     for (size_t i = 0; i < n; i++) {
-        s1[i] = s2[i]; 
+        if (s1[i] != s2[i])
+            return s1[i] - s2[i];
     }
 
-    return str1;
+    return 0;
 }
\ No newline at end of file
@@ -6,5 +6,6 @@ int strcmp(const char *, const char *);
 char *strcpy(char *, const char*);
 void *memset(void *, int, size_t);
 void *memcpy(void *, const void *, size_t);
+int memcmp(const void *, const void *, size_t);
 
 #endif
\ No newline at end of file